@@ -1,4 +1,4 @@
-#include "violet/all.h"
+#include "core.h"
 #include "action.h"
 
 const char *action_to_string(enum action action)
@@ -12,6 +12,7 @@ const char *action_to_string(enum action action)
 	case ACTION_ROTATE_CCW: return "Rotate counter-clockwise";
 	case ACTION_UNDO:       return "Undo";
 	case ACTION_RESET:      return "Reset";
+	case ACTION_REDO:       return "Redo";
 	case ACTION_COUNT:
 	default:                return "<null>";
 	}
@@ -27,6 +28,7 @@ b32 action_is_solo(enum action action)
 	case ACTION_ROTATE_CCW:
 	case ACTION_ROTATE_CW:
 	case ACTION_UNDO:
+	case ACTION_REDO:
 		return true;
 	case ACTION_RESET:
 	case ACTION_COUNT:
@@ -35,3 +37,23 @@ b32 action_is_solo(enum action action)
 	assert(false);
 	return false;
 }
+
+b32 action_is_move(enum action action)
+{
+	switch (action) {
+	case ACTION_MOVE_UP:
+	case ACTION_MOVE_DOWN:
+	case ACTION_MOVE_LEFT:
+	case ACTION_MOVE_RIGHT:
+		return true;
+	case ACTION_ROTATE_CCW:
+	case ACTION_ROTATE_CW:
+	case ACTION_UNDO:
+	case ACTION_RESET:
+	case ACTION_REDO:
+	case ACTION_COUNT:
+		return false;
+	}
+	assert(false);
+	return false;
+}
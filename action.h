@@ -8,8 +8,10 @@ enum action
 	ACTION_ROTATE_CCW,
 	ACTION_UNDO,
 	ACTION_RESET,
+	ACTION_REDO,
 	ACTION_COUNT,
 };
 
 const char *action_to_string(enum action action);
 b32         action_is_solo(enum action action);
+b32         action_is_move(enum action action);
@@ -1,15 +1,18 @@
 #include "config.h"
-#include "violet/all.h"
+#include "core.h"
 #include "action.h"
 #include "types.h"
 #include "constants.h"
 #include "actor.h"
+#include "level.h"
+#include "map.h"
 
 void actor_init(struct actor *actor, u32 player, s32 x, s32 y, struct level *level)
 {
 	actor->player = player;
 	actor->tile = (v2i){ .x = x, .y = y };
-	actor->pos = v2i_to_v2f(v2i_scale(actor->tile, TILE_SIZE));
+	actor->pos = v2i_scale(actor->tile, SUBTILE_DIM);
+	actor->prev_pos = actor->pos;
 	actor->dir = DIR_NONE;
 	actor->facing = DIR_DOWN;
 	actor->anim_milli = 0;
@@ -18,104 +21,98 @@ void actor_init(struct actor *actor, u32 player, s32 x, s32 y, struct level *lev
 }
 
 static
-s32 manhattan_dist(v2i v0, v2i v1)
+u32 actor__idx(const struct actor *actor, const struct level *level)
 {
-	return abs(v0.x - v1.x) + abs(v0.y - v1.y);
+	assert(actor >= level->actors && actor < level->actors + ACTOR_CNT_MAX);
+	return actor - level->actors;
 }
 
+/* Picks up the free clones next to tile, leaving them on the stack to
+ * have their own neighbours checked */
+static
+void actor__attach_adjacent(struct actor *actor, struct level *level, v2i tile,
+                            u32 *num_stacked)
+{
+	const u32 idx = actor__idx(actor, level);
+	for (enum dir dir = DIR_UP; dir <= DIR_RIGHT; ++dir) {
+		const u32 clone = level_free_clone(level, v2i_add(tile, g_dir_vec[dir]));
+		if (clone == CLONE_NONE)
+			continue;
+		level->clone_owner[clone] = idx;
+		level->clone_order[clone] = actor->num_clones++;
+		--level->num_free_clones;
+		level->clone_pos[clone] = v2i_sub(level->clone_pos[clone], actor->tile);
+		level->clone_stack[(*num_stacked)++] = clone;
+	}
+}
+
+/* Every free clone connected to the actor through its clones joins it */
 void actor_entered_tile(struct actor *actor, struct level *level,
                         u32 *num_clones_attached)
 {
-	const v2i tile = actor->tile;
+	const u32 idx = actor__idx(actor, level);
 	const u32 num_clones_attached_start = actor->num_clones;
+	u32 num_stacked = 0;
 #ifdef SHOW_TRAVELLED
-	level->map.tiles[tile.y][tile.x].travelled = true;
-	for (u32 i = 0; i < actor->num_clones; ++i) {
-		const v2i actor_clone = v2i_add(tile, actor->clones[i].pos);
-		level->map.tiles[actor_clone.y][actor_clone.x].travelled = true;
+	map_tile_mut(&level->map, actor->tile.y, actor->tile.x)->travelled = true;
+	for (u32 i = 0; i < level->num_clones; ++i) {
+		if (level->clone_owner[i] == idx) {
+			const v2i tile = level_clone_tile(level, i);
+			map_tile_mut(&level->map, tile.y, tile.x)->travelled = true;
+		}
 	}
 #endif
 
-	for (u32 j = 0; j < level->num_clones; ) {
-		if (manhattan_dist(level->clones[j].pos, tile) == 1) {
-			actor->clones[actor->num_clones].pos = v2i_sub(level->clones[j].pos, tile);
-			actor->clones[actor->num_clones].required = level->clones[j].required;
-			++actor->num_clones;
-			level->clones[j] = level->clones[--level->num_clones];
-		} else {
-			++j;
-		}
+	actor__attach_adjacent(actor, level, actor->tile, &num_stacked);
+	for (u32 i = 0; i < level->num_clones && level->num_free_clones > 0; ++i)
+		if (   level->clone_owner[i] == idx
+		    && level->clone_order[i] < num_clones_attached_start)
+			actor__attach_adjacent(actor, level, level_clone_tile(level, i), &num_stacked);
+	while (num_stacked > 0 && level->num_free_clones > 0) {
+		const u32 clone = level->clone_stack[--num_stacked];
+		actor__attach_adjacent(actor, level, level_clone_tile(level, clone), &num_stacked);
 	}
 
-clones:
-	for (u32 i = 0; i < actor->num_clones; ++i) {
-		const v2i actor_clone = v2i_add(tile, actor->clones[i].pos);
-		for (u32 j = 0; j < level->num_clones; ) {
-			if (manhattan_dist(level->clones[j].pos, actor_clone) == 1) {
-				actor->clones[actor->num_clones].pos = v2i_sub(level->clones[j].pos, tile);
-				actor->clones[actor->num_clones].required = level->clones[j].required;
-				++actor->num_clones;
-				level->clones[j] = level->clones[--level->num_clones];
-				goto clones;
-			} else {
-				++j;
-			}
-		}
-	}
 	if (num_clones_attached)
 		*num_clones_attached = actor->num_clones - num_clones_attached_start;
+	level_update_occupancy(level);
 }
 
 static
 b32 tile_occupied(const struct level *level, v2i tile,
                   const struct actor *excluded_actor)
 {
+	enum tile_type type;
+	const struct occupant *occupant;
 	if (tile.x < 0 || tile.x >= level->map.dim.x)
 		return true;
 	if (tile.y < 0 || tile.y >= level->map.dim.y)
 		return true;
-	if (   level->map.tiles[tile.y][tile.x].type != TILE_HALL
-	    && level->map.tiles[tile.y][tile.x].type != TILE_DOOR)
+	type = map_tile_type(&level->map, tile.y, tile.x);
+	if (type != TILE_HALL && type != TILE_DOOR)
+		return true;
+	occupant = level_occupant(level, tile);
+	if (occupant && occupant->player != excluded_actor->player)
 		return true;
-	for (u32 i = 0; i < level->num_clones; ++i)
-		if (v2i_equal(level->clones[i].pos, tile))
-			return true;
-	for (u32 i = 0; i < level->num_actors; ++i) {
-		const struct actor *actor = &level->actors[i];
-		if (actor->player == excluded_actor->player)
-			continue;
-		if (v2i_equal(actor->tile, tile))
-			return true;
-		for (u32 j = 0; j < actor->num_clones; ++j)
-			if (v2i_equal(v2i_add(actor->tile, actor->clones[j].pos), tile))
-				return true;
-	}
 	return false;
 }
 
+/* Whether the actor and the first num_clones clones it picked up fit
+ * when moved by offset, with the clones turned by perp if given */
 static
-b32 actor_can_move(const struct actor *actor, const struct level *level,
-                   v2i offset)
+b32 actor__fits(const struct actor *actor, const struct level *level, v2i offset,
+                v2i (*perp)(v2i), u32 num_clones)
 {
+	const u32 idx = actor__idx(actor, level);
 	const v2i tile = v2i_add(actor->tile, offset);
 	if (tile_occupied(level, tile, actor))
 		return false;
-	for (u32 i = 0; i < actor->num_clones; ++i) {
-		const v2i clone_tile = v2i_add(tile, actor->clones[i].pos);
-		if (tile_occupied(level, clone_tile, actor))
-			return false;
-	}
-	return true;
-}
-
-static
-b32 actor_can_rotate(const struct actor *actor, const struct level *level,
-                     b32 clockwise)
-{
-	v2i(*perp)(v2i) = clockwise ? v2i_rperp : v2i_lperp;
-	for (u32 i = 0; i < actor->num_clones; ++i) {
-		const v2i clone_tile = v2i_add(actor->tile, perp(actor->clones[i].pos));
-		if (tile_occupied(level, clone_tile, actor))
+	for (u32 i = 0; i < level->num_clones; ++i) {
+		v2i pos;
+		if (level->clone_owner[i] != idx || level->clone_order[i] >= num_clones)
+			continue;
+		pos = perp ? perp(level->clone_pos[i]) : level->clone_pos[i];
+		if (tile_occupied(level, v2i_add(tile, pos), actor))
 			return false;
 	}
 	return true;
@@ -126,31 +123,20 @@ b32 actor_can_act(const struct actor *actor, const struct level *level,
 {
 	switch (action) {
 	case ACTION_MOVE_UP:
-		if (!actor_can_move(actor, level, g_v2i_up))
-			return false;
-	break;
+		return actor__fits(actor, level, g_v2i_up, NULL, actor->num_clones);
 	case ACTION_MOVE_DOWN:
-		if (!actor_can_move(actor, level, g_v2i_down))
-			return false;
-	break;
+		return actor__fits(actor, level, g_v2i_down, NULL, actor->num_clones);
 	case ACTION_MOVE_LEFT:
-		if (!actor_can_move(actor, level, g_v2i_left))
-			return false;
-	break;
+		return actor__fits(actor, level, g_v2i_left, NULL, actor->num_clones);
 	case ACTION_MOVE_RIGHT:
-		if (!actor_can_move(actor, level, g_v2i_right))
-			return false;
-	break;
+		return actor__fits(actor, level, g_v2i_right, NULL, actor->num_clones);
 	case ACTION_ROTATE_CCW:
-		if (!actor_can_rotate(actor, level, false))
-			return false;
-	break;
+		return actor__fits(actor, level, g_v2i_zero, v2i_lperp, actor->num_clones);
 	case ACTION_ROTATE_CW:
-		if (!actor_can_rotate(actor, level, true))
-			return false;
-	break;
+		return actor__fits(actor, level, g_v2i_zero, v2i_rperp, actor->num_clones);
 	case ACTION_UNDO:
 	case ACTION_RESET:
+	case ACTION_REDO:
 	break;
 	case ACTION_COUNT:
 		assert(false);
@@ -158,67 +144,30 @@ b32 actor_can_act(const struct actor *actor, const struct level *level,
 	return true;
 }
 
+/* Whether action can be taken back, leaving the clones it picked up */
 b32 actor_can_undo(const struct actor *actor, const struct level *level,
                    enum action action, u32 num_clones_acquired)
 {
 	const u32 num_clones = actor->num_clones - num_clones_acquired;
 	switch (action) {
 	case ACTION_MOVE_UP:
-		if (tile_occupied(level, v2i_add(actor->tile, g_v2i_down), actor))
-			return false;
-		for (u32 j = 0; j < num_clones; ++j) {
-			const v2i clone_tile = v2i_add(actor->tile, actor->clones[j].pos);
-			if (tile_occupied(level, v2i_add(clone_tile, g_v2i_down), actor))
-				return false;
-		}
-	break;
+		return actor__fits(actor, level, g_v2i_down, NULL, num_clones);
 	case ACTION_MOVE_DOWN:
-		if (tile_occupied(level, v2i_add(actor->tile, g_v2i_up), actor))
-			return false;
-		for (u32 j = 0; j < num_clones; ++j) {
-			const v2i clone_tile = v2i_add(actor->tile, actor->clones[j].pos);
-			if (tile_occupied(level, v2i_add(clone_tile, g_v2i_up), actor))
-				return false;
-		}
-	break;
+		return actor__fits(actor, level, g_v2i_up, NULL, num_clones);
 	case ACTION_MOVE_LEFT:
-		if (tile_occupied(level, v2i_add(actor->tile, g_v2i_right), actor))
-			return false;
-		for (u32 j = 0; j < num_clones; ++j) {
-			const v2i clone_tile = v2i_add(actor->tile, actor->clones[j].pos);
-			if (tile_occupied(level, v2i_add(clone_tile, g_v2i_right), actor))
-				return false;
-		}
-	break;
+		return actor__fits(actor, level, g_v2i_right, NULL, num_clones);
 	case ACTION_MOVE_RIGHT:
-		if (tile_occupied(level, v2i_add(actor->tile, g_v2i_left), actor))
-			return false;
-		for (u32 j = 0; j < num_clones; ++j) {
-			const v2i clone_tile = v2i_add(actor->tile, actor->clones[j].pos);
-			if (tile_occupied(level, v2i_add(clone_tile, g_v2i_left), actor))
-				return false;
-		}
-	break;
+		return actor__fits(actor, level, g_v2i_left, NULL, num_clones);
 	case ACTION_ROTATE_CW:
-		for (u32 j = 0; j < num_clones; ++j) {
-			const v2i clone_tile = v2i_add(actor->tile, v2i_lperp(actor->clones[j].pos));
-			if (tile_occupied(level, clone_tile, actor))
-				return false;
-		}
-	break;
+		return actor__fits(actor, level, g_v2i_zero, v2i_lperp, num_clones);
 	case ACTION_ROTATE_CCW:
-		for (u32 j = 0; j < num_clones; ++j) {
-			const v2i clone_tile = v2i_add(actor->tile, v2i_rperp(actor->clones[j].pos));
-			if (tile_occupied(level, clone_tile, actor))
-				return false;
-		}
-	break;
+		return actor__fits(actor, level, g_v2i_zero, v2i_rperp, num_clones);
 	case ACTION_UNDO:
 	case ACTION_RESET:
+	case ACTION_REDO:
 	case ACTION_COUNT:
 		assert(false);
 	break;
 	}
 	return true;
 }
-
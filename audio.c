@@ -1,60 +1,649 @@
 #include "config.h"
 #include "violet/all.h"
 #include "audio.h"
+#include "action.h"
+#include "types.h"
+#include "disk.h"
 #ifdef AUDIO_ENABLED
 #include <SDL_mixer.h>
 
 
 /*
- * sound handle: Mix_Chunk
- * music handle: Mix_Music
+ * Sound effects bypass SDL_mixer's channels.  Each one is decoded and
+ * converted to the device format by Mix_LoadWAV at load time, and the
+ * samples are kept so the audio thread can add them straight into the
+ * output buffer.  sound_play() only appends a command to a single-producer,
+ * single-consumer queue, so the game thread never waits on the audio lock
+ * and the sound starts with the next buffer the device asks for.
+ *
+ * Music is streamed: a decoder thread reads uncompressed AIFF/WAV from disk
+ * a chunk at a time, converts it to the device format and fills a ring per
+ * track, which the same callback drains.  Two tracks let a new score fade
+ * in while the old one fades out, and each holds only its ring plus the
+ * converter's working buffers.  The web build has neither threads nor raw
+ * PCM files, so it keeps SDL_mixer's Mix_Music there.
  */
 
+enum audio__command_type
+{
+	AUDIO__COMMAND_PLAY,
+	AUDIO__COMMAND_STOP,
+};
+
+struct audio__command
+{
+	enum audio__command_type type;
+	const struct sound *sound;
+};
+
+struct audio__voice
+{
+	const struct sound *sound;
+	u32 pos;
+};
+
+#ifndef __EMSCRIPTEN__
+enum audio__track_state
+{
+	AUDIO__TRACK_FREE,
+	AUDIO__TRACK_PLAYING,
+	AUDIO__TRACK_FADING_OUT,
+	AUDIO__TRACK_DONE,
+};
+
+struct audio__pcm
+{
+	SDL_AudioFormat format;
+	int channels, rate;
+	u32 data_start, data_sz, frame_sz;
+};
+
+struct audio__track
+{
+	/* shared - the decoder only touches a track's file while the mixer
+	 * ignores it (FREE), and the ring only through fill */
+	SDL_atomic_t state;
+	SDL_atomic_t fill;
+	s16 ring[MUSIC_RING_SAMPLES];
+
+	/* decoder thread */
+	char file[MUSIC_PATH_MAX];
+	SDL_RWops *rw;
+	SDL_AudioStream *stream;
+	u32 data_start, data_sz, data_pos, frame_sz;
+	b32 failed;
+	u32 write;
+
+	/* audio thread */
+	u32 read;
+	u32 gain;
+};
+#endif
+
 static b32 g_sound_enabled = true;
 static b32 g_music_enabled = true;
 static struct music g_music = { .handle = NULL };
+static int g_frequency, g_channels;
+
+/* written by the game thread at the tail, read by the audio thread at the head */
+static struct audio__command g_commands[AUDIO_COMMAND_QUEUE_MAX];
+static SDL_atomic_t g_command_head;
+static SDL_atomic_t g_command_tail;
+
+/* only touched by the audio thread */
+static struct audio__voice g_voices[AUDIO_VOICE_CNT_MAX];
+static u32 g_num_voices = 0;
+
+#ifndef __EMSCRIPTEN__
+/* one fading in, one fading out */
+static struct audio__track g_tracks[2];
+static u32 g_ring_sz, g_fade_frames;
+static SDL_Thread *g_decoder = NULL;
+static SDL_sem *g_decoder_sem = NULL;
+static SDL_atomic_t g_decoder_quit;
+static SDL_mutex *g_request_mutex = NULL;
+static char g_request_file[MUSIC_PATH_MAX];
+static u32 g_request_id = 0;
+#endif
+
+
+static
+void audio__push(enum audio__command_type type, const struct sound *sound)
+{
+	const int tail = SDL_AtomicGet(&g_command_tail);
+	const int next = (tail + 1) % AUDIO_COMMAND_QUEUE_MAX;
+
+	/* a full queue means the audio thread is stalled - dropping is fine */
+	if (next == SDL_AtomicGet(&g_command_head))
+		return;
+
+	g_commands[tail].type = type;
+	g_commands[tail].sound = sound;
+	SDL_AtomicSet(&g_command_tail, next);
+}
+
+static
+void audio__start(const struct sound *sound)
+{
+	u32 idx = g_num_voices;
+
+	/* restart a sound that is already playing rather than layering it */
+	for (u32 i = 0; i < g_num_voices; ++i) {
+		if (g_voices[i].sound == sound) {
+			idx = i;
+			break;
+		}
+	}
+
+	/* out of voices: steal the one closest to finishing */
+	if (idx == AUDIO_VOICE_CNT_MAX) {
+		idx = 0;
+		for (u32 i = 1; i < g_num_voices; ++i)
+			if (   g_voices[i].sound->num_samples - g_voices[i].pos
+			    <  g_voices[idx].sound->num_samples - g_voices[idx].pos)
+				idx = i;
+	} else if (idx == g_num_voices) {
+		++g_num_voices;
+	}
+
+	g_voices[idx].sound = sound;
+	g_voices[idx].pos = 0;
+}
+
+static
+void audio__stop(const struct sound *sound)
+{
+	for (u32 i = 0; i < g_num_voices; ++i) {
+		if (g_voices[i].sound == sound) {
+			g_voices[i] = g_voices[--g_num_voices];
+			break;
+		}
+	}
+}
+
+/* Reads from the asset archive when it has the file */
+static
+SDL_RWops *audio__open_rw(const char *file)
+{
+	u32 size;
+	const void *data = archive_find(file, &size);
+	return data ? SDL_RWFromConstMem(data, size) : SDL_RWFromFile(file, "rb");
+}
+
+#ifndef __EMSCRIPTEN__
+/* Reads the header of an uncompressed AIFF or WAV file, leaving the
+ * stream positioned anywhere. */
+static
+b32 audio__open_pcm(SDL_RWops *rw, struct audio__pcm *pcm)
+{
+	char id[4];
+	b32 aiff, have_format = false, have_data = false;
+	Sint64 chunk_start;
+	u32 chunk_sz, bits = 0;
+
+	if (   SDL_RWread(rw, id, 4, 1) != 1
+	    || SDL_RWseek(rw, 4, RW_SEEK_CUR) < 0)
+		return false;
+	if (memcmp(id, "FORM", 4) == 0)
+		aiff = true;
+	else if (memcmp(id, "RIFF", 4) == 0)
+		aiff = false;
+	else
+		return false;
+	if (   SDL_RWread(rw, id, 4, 1) != 1
+	    || memcmp(id, aiff ? "AIFF" : "WAVE", 4) != 0)
+		return false;
+
+	while (!(have_format && have_data)) {
+		if (SDL_RWread(rw, id, 4, 1) != 1)
+			return false;
+		chunk_sz = aiff ? SDL_ReadBE32(rw) : SDL_ReadLE32(rw);
+		chunk_start = SDL_RWtell(rw);
+
+		if (aiff && memcmp(id, "COMM", 4) == 0) {
+			u8 rate[10];
+			u32 exponent;
+			u64 mantissa = 0;
+
+			pcm->channels = SDL_ReadBE16(rw);
+			SDL_ReadBE32(rw); /* frame count, implied by the data size */
+			bits = SDL_ReadBE16(rw);
+			if (SDL_RWread(rw, rate, 10, 1) != 1)
+				return false;
+			/* 80-bit extended float - only whole rates are expected */
+			exponent = ((rate[0] & 0x7f) << 8) | rate[1];
+			for (u32 i = 2; i < 10; ++i)
+				mantissa = (mantissa << 8) | rate[i];
+			if (exponent < 16383 || exponent > 16383 + 63)
+				return false;
+			pcm->rate = (int)(mantissa >> (16383 + 63 - exponent));
+			pcm->format = bits == 8  ? AUDIO_S8
+			            : bits == 16 ? AUDIO_S16MSB
+			            : bits == 32 ? AUDIO_S32MSB : 0;
+			have_format = true;
+		} else if (aiff && memcmp(id, "SSND", 4) == 0) {
+			const u32 offset = SDL_ReadBE32(rw);
+			SDL_ReadBE32(rw); /* block size */
+			pcm->data_start = (u32)SDL_RWtell(rw) + offset;
+			pcm->data_sz = chunk_sz - 8 - offset;
+			have_data = true;
+		} else if (!aiff && memcmp(id, "fmt ", 4) == 0) {
+			if (SDL_ReadLE16(rw) != 1) /* integer PCM */
+				return false;
+			pcm->channels = SDL_ReadLE16(rw);
+			pcm->rate = SDL_ReadLE32(rw);
+			SDL_ReadLE32(rw); /* byte rate */
+			SDL_ReadLE16(rw); /* block align */
+			bits = SDL_ReadLE16(rw);
+			pcm->format = bits == 8  ? AUDIO_U8
+			            : bits == 16 ? AUDIO_S16LSB
+			            : bits == 32 ? AUDIO_S32LSB : 0;
+			have_format = true;
+		} else if (!aiff && memcmp(id, "data", 4) == 0) {
+			pcm->data_start = (u32)chunk_start;
+			pcm->data_sz = chunk_sz;
+			have_data = true;
+		}
+
+		/* chunks are padded to an even size in both formats */
+		if (SDL_RWseek(rw, chunk_start + chunk_sz + (chunk_sz & 1), RW_SEEK_SET) < 0)
+			return false;
+	}
+
+	if (pcm->format == 0 || pcm->channels == 0 || pcm->rate <= 0)
+		return false;
+
+	pcm->frame_sz = pcm->channels * bits / 8;
+	pcm->data_sz -= pcm->data_sz % pcm->frame_sz;
+	return pcm->data_sz > 0;
+}
+
+static
+b32 audio__track_open(struct audio__track *track, const char *file)
+{
+	struct audio__pcm pcm;
+
+	track->rw = audio__open_rw(file);
+	if (!track->rw)
+		goto err;
+
+	if (   !audio__open_pcm(track->rw, &pcm)
+	    || pcm.frame_sz > MUSIC_DECODE_BYTES
+	    || SDL_RWseek(track->rw, pcm.data_start, RW_SEEK_SET) < 0)
+		goto err_rw;
+
+	track->stream = SDL_NewAudioStream(pcm.format, pcm.channels, pcm.rate,
+	                                   AUDIO_S16SYS, g_channels, g_frequency);
+	if (!track->stream)
+		goto err_rw;
+
+	strncpy(track->file, file, MUSIC_PATH_MAX - 1);
+	track->file[MUSIC_PATH_MAX - 1] = '\0';
+	track->data_start = pcm.data_start;
+	track->data_sz = pcm.data_sz;
+	track->data_pos = 0;
+	track->frame_sz = pcm.frame_sz;
+	track->failed = false;
+	track->write = 0;
+	track->read = 0;
+	track->gain = 0;
+	SDL_AtomicSet(&track->fill, 0);
+	return true;
+
+err_rw:
+	SDL_RWclose(track->rw);
+	track->rw = NULL;
+err:
+	log_error("Unable to stream music '%s'", file);
+	return false;
+}
+
+static
+void audio__track_close(struct audio__track *track)
+{
+	if (track->stream) {
+		SDL_FreeAudioStream(track->stream);
+		track->stream = NULL;
+	}
+	if (track->rw) {
+		SDL_RWclose(track->rw);
+		track->rw = NULL;
+	}
+	track->file[0] = '\0';
+}
+
+/* Feeds the converter the next chunk of the file, looping at the end. */
+static
+b32 audio__track_decode(struct audio__track *track, u8 *buf)
+{
+	u32 sz;
+
+	if (track->data_pos == track->data_sz) {
+		if (SDL_RWseek(track->rw, track->data_start, RW_SEEK_SET) < 0)
+			return false;
+		track->data_pos = 0;
+	}
+
+	sz = min(MUSIC_DECODE_BYTES - MUSIC_DECODE_BYTES % track->frame_sz,
+	         track->data_sz - track->data_pos);
+	if (SDL_RWread(track->rw, buf, 1, sz) != sz)
+		return false;
+	track->data_pos += sz;
+	return SDL_AudioStreamPut(track->stream, buf, sz) == 0;
+}
+
+/* Tops up the ring with converted samples, whole frames at a time. */
+static
+void audio__track_fill(struct audio__track *track, u8 *buf)
+{
+	while (!track->failed) {
+		const u32 space = g_ring_sz - SDL_AtomicGet(&track->fill);
+		const u32 n = min(space, g_ring_sz - track->write);
+		int sz;
+
+		if (n == 0)
+			break;
+
+		sz = SDL_AudioStreamGet(track->stream, &track->ring[track->write],
+		                        n * sizeof(s16));
+		if (sz == 0 && audio__track_decode(track, buf))
+			continue;
+
+		if (sz <= 0) {
+			log_error("Music stream '%s' failed", track->file);
+			track->failed = true;
+			SDL_AtomicCAS(&track->state, AUDIO__TRACK_PLAYING, AUDIO__TRACK_FADING_OUT);
+			break;
+		}
 
+		track->write = (track->write + sz / sizeof(s16)) % g_ring_sz;
+		SDL_AtomicAdd(&track->fill, sz / sizeof(s16));
+	}
+}
+
+/* Starts the requested track (or stops all on an empty file name), fading
+ * out whatever else is playing.  Returns false if both tracks are still
+ * busy, so the request is retried once a fade out finishes. */
+static
+b32 audio__track_request(const char *file)
+{
+	struct audio__track *track = NULL;
+
+	if (file[0] != '\0') {
+		/* keep, or bring back, a track already streaming this file */
+		for (u32 i = 0; i < countof(g_tracks) && !track; ++i) {
+			struct audio__track *t = &g_tracks[i];
+			if (   strcmp(t->file, file) == 0
+			    && (   SDL_AtomicGet(&t->state) == AUDIO__TRACK_PLAYING
+			        || SDL_AtomicCAS(&t->state, AUDIO__TRACK_FADING_OUT,
+			                         AUDIO__TRACK_PLAYING)))
+				track = t;
+		}
+
+		for (u32 i = 0; i < countof(g_tracks) && !track; ++i)
+			if (SDL_AtomicGet(&g_tracks[i].state) == AUDIO__TRACK_FREE)
+				track = &g_tracks[i];
+		if (!track)
+			return false;
+
+		if (   SDL_AtomicGet(&track->state) == AUDIO__TRACK_FREE
+		    && !audio__track_open(track, file))
+			track = NULL;
+	}
+
+	for (u32 i = 0; i < countof(g_tracks); ++i)
+		if (&g_tracks[i] != track)
+			SDL_AtomicCAS(&g_tracks[i].state, AUDIO__TRACK_PLAYING,
+			              AUDIO__TRACK_FADING_OUT);
+
+	if (track)
+		SDL_AtomicSet(&track->state, AUDIO__TRACK_PLAYING);
+	return true;
+}
+
+static
+int audio__decoder(void *udata)
+{
+	static u8 buf[MUSIC_DECODE_BYTES];
+	char file[MUSIC_PATH_MAX];
+	u32 request_id, handled_id = 0;
+
+	while (!SDL_AtomicGet(&g_decoder_quit)) {
+		SDL_LockMutex(g_request_mutex);
+		request_id = g_request_id;
+		strcpy(file, g_request_file);
+		SDL_UnlockMutex(g_request_mutex);
+
+		if (request_id != handled_id && audio__track_request(file))
+			handled_id = request_id;
+
+		for (u32 i = 0; i < countof(g_tracks); ++i) {
+			struct audio__track *track = &g_tracks[i];
+			switch (SDL_AtomicGet(&track->state)) {
+			case AUDIO__TRACK_FREE:
+			break;
+			case AUDIO__TRACK_PLAYING:
+			case AUDIO__TRACK_FADING_OUT:
+				audio__track_fill(track, buf);
+			break;
+			case AUDIO__TRACK_DONE:
+				audio__track_close(track);
+				SDL_AtomicSet(&track->state, AUDIO__TRACK_FREE);
+			break;
+			}
+		}
+
+		SDL_SemWaitTimeout(g_decoder_sem, MUSIC_DECODE_INTERVAL_MILLI);
+	}
+	return 0;
+}
+
+static
+void audio__music_request(const char *file)
+{
+	SDL_LockMutex(g_request_mutex);
+	strncpy(g_request_file, file, MUSIC_PATH_MAX - 1);
+	++g_request_id;
+	SDL_UnlockMutex(g_request_mutex);
+	SDL_SemPost(g_decoder_sem);
+}
+
+/* runs on the audio thread - ramps the gain one frame at a time */
+static
+void audio__mix_track(struct audio__track *track, s16 *out, u32 num_samples)
+{
+	const int state = SDL_AtomicGet(&track->state);
+	const u32 n = min(num_samples, (u32)SDL_AtomicGet(&track->fill));
+	int fill;
+
+	if (state != AUDIO__TRACK_PLAYING && state != AUDIO__TRACK_FADING_OUT)
+		return;
+
+	for (u32 i = 0; i < n; i += g_channels) {
+		const r32 amp = MUSIC_VOLUME * track->gain / g_fade_frames;
+		for (int c = 0; c < g_channels; ++c) {
+			const s32 sample = (s32)out[i+c] + (s32)(track->ring[track->read+c] * amp);
+			out[i+c] = (s16)clamp(-32768, sample, 32767);
+		}
+		track->read += g_channels;
+		if (track->read == g_ring_sz)
+			track->read = 0;
+		if (state == AUDIO__TRACK_PLAYING && track->gain < g_fade_frames)
+			++track->gain;
+		else if (state == AUDIO__TRACK_FADING_OUT && track->gain > 0)
+			--track->gain;
+	}
+
+	fill = SDL_AtomicAdd(&track->fill, -(int)n) - (int)n;
+	if (   state == AUDIO__TRACK_FADING_OUT
+	    && (track->gain == 0 || fill == 0)) {
+		track->gain = 0;
+		SDL_AtomicCAS(&track->state, AUDIO__TRACK_FADING_OUT, AUDIO__TRACK_DONE);
+		SDL_SemPost(g_decoder_sem);
+	} else if ((u32)fill <= g_ring_sz / 2) {
+		SDL_SemPost(g_decoder_sem);
+	}
+}
+#endif // __EMSCRIPTEN__
+
+/* runs on the audio thread after SDL_mixer has mixed its channels */
+static
+void audio__mix(void *udata, Uint8 *stream, int len)
+{
+	s16 *out = (s16*)stream;
+	const u32 num_samples = (u32)len / sizeof(s16);
+	int head = SDL_AtomicGet(&g_command_head);
+	const int tail = SDL_AtomicGet(&g_command_tail);
+
+	while (head != tail) {
+		const struct audio__command *command = &g_commands[head];
+		switch (command->type) {
+		case AUDIO__COMMAND_PLAY:
+			audio__start(command->sound);
+		break;
+		case AUDIO__COMMAND_STOP:
+			audio__stop(command->sound);
+		break;
+		}
+		head = (head + 1) % AUDIO_COMMAND_QUEUE_MAX;
+	}
+	SDL_AtomicSet(&g_command_head, head);
+
+#ifndef __EMSCRIPTEN__
+	for (u32 i = 0; i < countof(g_tracks); ++i)
+		audio__mix_track(&g_tracks[i], out, num_samples);
+#endif
+
+	for (u32 i = 0; i < g_num_voices; ) {
+		struct audio__voice *voice = &g_voices[i];
+		const s16 *in = voice->sound->samples + voice->pos;
+		const u32 n = min(num_samples, voice->sound->num_samples - voice->pos);
+
+		for (u32 j = 0; j < n; ++j) {
+			const s32 sample = (s32)out[j] + in[j];
+			out[j] = (s16)clamp(-32768, sample, 32767);
+		}
+
+		voice->pos += n;
+		if (voice->pos == voice->sound->num_samples)
+			*voice = g_voices[--g_num_voices];
+		else
+			++i;
+	}
+}
 
 b32 audio_init()
 {
-	if (Mix_OpenAudio(22050, MIX_DEFAULT_FORMAT, 2, 1024) == -1) {
+	Uint16 format;
+
+	/* SDL_mixer may change the rate & channel count, but not the format */
+	if (Mix_OpenAudio(AUDIO_FREQUENCY, AUDIO_S16SYS, 2, AUDIO_BUFFER_FRAMES) == -1) {
 		log_error("Unable to open audio: %s\n", SDL_GetError());
 		return false;
 	}
 
-	if (Mix_AllocateChannels(16) != 16) {
-		log_error("Unable to allocate channels: %s\n", SDL_GetError());
-		return false;
+	if (!Mix_QuerySpec(&g_frequency, &format, &g_channels)) {
+		log_error("Unable to query audio: %s\n", SDL_GetError());
+		goto err;
 	}
+	log_info("audio: %d Hz, %d channels, %d frame buffer",
+	         g_frequency, g_channels, AUDIO_BUFFER_FRAMES);
 
-	Mix_VolumeMusic(MIX_MAX_VOLUME / 8);
+#ifndef __EMSCRIPTEN__
+	g_ring_sz = MUSIC_RING_SAMPLES - MUSIC_RING_SAMPLES % g_channels;
+	g_fade_frames = (u32)g_frequency * MUSIC_FADE_MILLI / 1000;
+	SDL_AtomicSet(&g_decoder_quit, 0);
+	g_decoder_sem = SDL_CreateSemaphore(0);
+	g_request_mutex = SDL_CreateMutex();
+	if (!g_decoder_sem || !g_request_mutex) {
+		log_error("Unable to create music sync: %s\n", SDL_GetError());
+		goto err_sync;
+	}
+	g_decoder = SDL_CreateThread(audio__decoder, "music", NULL);
+	if (!g_decoder) {
+		log_error("Unable to start music thread: %s\n", SDL_GetError());
+		goto err_sync;
+	}
+#else
+	Mix_VolumeMusic((int)(MIX_MAX_VOLUME * MUSIC_VOLUME));
+#endif
+
+	SDL_AtomicSet(&g_command_head, 0);
+	SDL_AtomicSet(&g_command_tail, 0);
+	g_num_voices = 0;
+	Mix_SetPostMix(audio__mix, NULL);
 
 	return true;
+
+#ifndef __EMSCRIPTEN__
+err_sync:
+	if (g_request_mutex)
+		SDL_DestroyMutex(g_request_mutex);
+	if (g_decoder_sem)
+		SDL_DestroySemaphore(g_decoder_sem);
+	g_request_mutex = NULL;
+	g_decoder_sem = NULL;
+#endif
+err:
+	Mix_CloseAudio();
+	return false;
 }
 
+/* Closes the device first, so sounds can be freed afterwards without racing
+ * the audio thread. */
 void audio_destroy()
 {
+	Mix_SetPostMix(NULL, NULL);
+#ifndef __EMSCRIPTEN__
+	SDL_AtomicSet(&g_decoder_quit, 1);
+	SDL_SemPost(g_decoder_sem);
+	SDL_WaitThread(g_decoder, NULL);
+	g_decoder = NULL;
+	for (u32 i = 0; i < countof(g_tracks); ++i) {
+		audio__track_close(&g_tracks[i]);
+		SDL_AtomicSet(&g_tracks[i].state, AUDIO__TRACK_FREE);
+	}
+	SDL_DestroyMutex(g_request_mutex);
+	SDL_DestroySemaphore(g_decoder_sem);
+	g_request_mutex = NULL;
+	g_decoder_sem = NULL;
+#endif
 	Mix_CloseAudio();
 }
 
 b32 sound_init(struct sound *sound, const char *file)
 {
-	sound->handle = Mix_LoadWAV(file);
-	sound->channel = -1;
-	return sound->handle != NULL;
+	SDL_RWops *rw = audio__open_rw(file);
+	Mix_Chunk *chunk = rw ? Mix_LoadWAV_RW(rw, 1) : NULL;
+
+	sound->samples = NULL;
+	sound->num_samples = 0;
+
+	if (!chunk) {
+		log_error("Unable to load sound '%s': %s\n", file, Mix_GetError());
+		return false;
+	}
+
+	/* the chunk is already in the device's format, rate & channel layout */
+	sound->num_samples = chunk->alen / sizeof(s16);
+	sound->samples = malloc(sound->num_samples * sizeof(s16));
+	memcpy(sound->samples, chunk->abuf, sound->num_samples * sizeof(s16));
+	Mix_FreeChunk(chunk);
+	return true;
 }
 
 void sound_play(struct sound *sound)
 {
-	if (sound->channel >= 0)
-		Mix_HaltChannel(sound->channel);
-	if (g_sound_enabled)
-		sound->channel = Mix_PlayChannel(-1, sound->handle, 0);
+	if (sound->num_samples == 0)
+		return;
+	audio__push(g_sound_enabled ? AUDIO__COMMAND_PLAY : AUDIO__COMMAND_STOP, sound);
 }
 
 void sound_destroy(struct sound *sound)
 {
-	Mix_FreeChunk(sound->handle);
+	free(sound->samples);
+	sound->samples = NULL;
+	sound->num_samples = 0;
 }
 
 b32 sound_enabled(void)
@@ -77,40 +666,64 @@ void sound_toggle(void)
 	g_sound_enabled = !g_sound_enabled;
 }
 
-b32 music_init(struct music *music, const char *file)
+static
+void audio__music_start(const struct music *music)
 {
 #ifdef __EMSCRIPTEN__
-	/* Sweet Mary Mother of Jesus why do I have to do it this way?!?! */
-	SDL_RWops *ops = SDL_RWFromFile(file, "rb");
-	music->handle = Mix_LoadMUS_RW(ops, 1);
+	/* Mix_FadeInMusic is an SDL2 feature */
+	Mix_PlayMusic(music->handle, -1);
 #else
-	music->handle = Mix_LoadMUS(file);
+	audio__music_request(music->file);
 #endif
-	return music->handle != NULL;
 }
 
-void music_play(struct music *music)
+static
+void audio__music_halt(void)
 {
-	g_music = *music;
-	if (g_music_enabled) {
 #ifdef __EMSCRIPTEN__
-		/* Mix_FadeInMusic is an SDL2 feature */
-		Mix_PlayMusic(music->handle, -1);
+	Mix_FadeOutMusic(MUSIC_FADE_MILLI);
 #else
-		Mix_FadeInMusic(music->handle, -1, 1000);
+	audio__music_request("");
+#endif
+}
+
+/* Only checks the file on desktop - the decoder opens its own handle. */
+b32 music_init(struct music *music, const char *file)
+{
+	music->handle = NULL;
+	strncpy(music->file, file, MUSIC_PATH_MAX - 1);
+	music->file[MUSIC_PATH_MAX - 1] = '\0';
+#ifdef __EMSCRIPTEN__
+	/* Sweet Mary Mother of Jesus why do I have to do it this way?!?! */
+	SDL_RWops *ops = audio__open_rw(file);
+	music->handle = ops ? Mix_LoadMUS_RW(ops, 1) : NULL;
+	return music->handle != NULL;
+#else
+	struct audio__pcm pcm;
+	SDL_RWops *rw = audio__open_rw(file);
+	b32 valid;
+	if (!rw)
+		return false;
+	valid = audio__open_pcm(rw, &pcm);
+	SDL_RWclose(rw);
+	return valid;
 #endif
-	}
 }
 
-void music_stop(void)
+void music_play(struct music *music)
 {
-	Mix_FadeOutMusic(1000);
-	g_music.handle = NULL;
+	g_music = *music;
+	if (g_music_enabled)
+		audio__music_start(music);
 }
 
 void music_destroy(struct music *music)
 {
+#ifdef __EMSCRIPTEN__
 	Mix_FreeMusic(music->handle);
+#endif
+	music->handle = NULL;
+	music->file[0] = '\0';
 }
 
 b32 music_enabled(void)
@@ -122,8 +735,8 @@ void music_enable(void)
 {
 	if (!g_music_enabled) {
 		g_music_enabled = true;
-		if (g_music.handle)
-			music_play(&g_music);
+		if (g_music.file[0] != '\0')
+			audio__music_start(&g_music);
 	}
 }
 
@@ -131,7 +744,7 @@ void music_disable(void)
 {
 	if (g_music_enabled) {
 		g_music_enabled = false;
-		music_stop();
+		audio__music_halt();
 	}
 }
 
@@ -1,10 +1,11 @@
 struct sound {
-	void *handle;
-	int channel;
+	s16 *samples;
+	u32 num_samples;
 };
 
 struct music {
 	void *handle;
+	char file[MUSIC_PATH_MAX];
 };
 
 b32  audio_init(void);
@@ -20,7 +21,6 @@ void sound_toggle(void);
 
 b32  music_init(struct music *music, const char *file);
 void music_play(struct music *music);
-void music_stop(void);
 void music_destroy(struct music *music);
 b32  music_enabled(void);
 void music_enable(void);
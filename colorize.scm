@@ -1,17 +0,0 @@
-(define (colorize pattern hue saturation lightness)
-	(let* ((filelist (cadr (file-glob pattern 1))))
-		(while (not (null? filelist))
-			(let*
-				(
-					(filename (car filelist))
-					(image (car (gimp-file-load RUN-NONINTERACTIVE filename filename)))
-					(drawable (car (gimp-image-get-active-layer image)))
-				)
-				(gimp-colorize drawable hue saturation lightness)
-				(gimp-file-save RUN-NONINTERACTIVE image drawable filename filename)
-				(gimp-image-delete image)
-			)
-			(set! filelist (cdr filelist))
-		)
-	)
-)
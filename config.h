@@ -1,20 +1,54 @@
 #define APP_NAME "Cohesion"
-#define PLAYER_CNT_MAX 2
-#define MAP_DIM_MAX 14
+#define PLAYER_CNT_MAX 8
+#define PLAYER_CNT_LOCAL 2
+#define MAP_DIM_MAX 256
+#define MAP_VIEW_DIM 14
+#define MAP_CHUNK_DIM 8
 #define MAP_TIP_MAX 64
 #define TILE_SIZE 32
-#define ACTOR_CNT_MAX 2
-#define CLONE_CNT_MAX 32
+#define ACTOR_CNT_MAX 8
 #define WALK_SPEED (TILE_SIZE * 4)
+#define SIM_TICK_MILLI 5
+#define SIM_LAG_MAX_MILLI 250
+#define SUBTILE_DIM 200
+#define WALK_STEP (SUBTILE_DIM * WALK_SPEED / TILE_SIZE * SIM_TICK_MILLI / 1000)
 #define TILE_BORDER_DIM 1
 #define FPS_CAP 30
-#define FPS_IDLE 4
 #define IDLE_TIMER_MILLI 5000
 // #define SHOW_TRAVELLED
 #define SHOW_EFFECTS
+// #define PROFILE
+#define PROFILE_FRAME_CNT 256
+#define PROFILE_ZONE_CNT_MAX 64
+#define PROFILE_DEPTH_MAX 16
 #define LEVEL_COMPLETE_EFFECT_DURATION_MILLI 1000
 #define ROTATION_EFFECT_DURATION_MILLI 250
 #define STONE_GLOW_EFFECT_DURATION_MILLI 250
 #define ACTION_REPEAT_INTERVAL 150
-#define HISTORY_EVENT_MAX 512
+#define INPUT_QUEUE_MAX 4
+#define INPUT_BUFFER_MILLI 300
+#define HISTORY_SNAPSHOT_INTERVAL 64
+#define MAP_CACHE_CNT 8
+#define REPLAY_RUN_CNT_MAX 256
+#define FLOOR_CACHE_CNT 16
+#define PARTICLE_BG_CNT_MAX 16
+#define PARTICLE_DOOR_CNT_MAX 256
+#define PARTICLE_DISSOLVE_CNT_MAX 1024
 #define AUDIO_ENABLED
+#define AUDIO_FREQUENCY 48000
+#ifdef __EMSCRIPTEN__
+#define AUDIO_BUFFER_FRAMES 1024
+#else
+#define AUDIO_BUFFER_FRAMES 256
+#endif
+#define AUDIO_VOICE_CNT_MAX 16
+#define AUDIO_COMMAND_QUEUE_MAX 64
+#define MUSIC_PATH_MAX 128
+#define MUSIC_RING_SAMPLES 32768
+#define MUSIC_DECODE_BYTES 16384
+#define MUSIC_DECODE_INTERVAL_MILLI 20
+#define MUSIC_FADE_MILLI 1000
+#define MUSIC_VOLUME 0.125f
+#define SETTINGS_SAVE_DELAY_MILLI 500
+#define TASK_WORKER_CNT_MAX 4
+#define TASK_QUEUE_MAX 64
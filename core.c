@@ -0,0 +1,8 @@
+#include "config.h"
+#define VIOLET_IMPLEMENTATION
+#include "core.h"
+
+/*
+ * violet's implementation for headless tools.  The game gets it from
+ * main.c together with the gui, so it never links this object.
+ */
@@ -0,0 +1,10 @@
+/*
+ * The parts of violet the game rules need.  Sources behind
+ * libcohesion_core.a include this rather than violet/all.h, so neither
+ * they nor the tools linking them pull in the gui, SDL or OpenGL.
+ */
+#include "violet/core.h"
+#include "violet/array.h"
+#include "violet/imath.h"
+#include "violet/fmath.h"
+#include "violet/vson.h"
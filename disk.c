@@ -1,16 +1,175 @@
+#include <sys/stat.h>
+#if !defined(__EMSCRIPTEN__) && !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#define DISK_MMAP
+#endif
 #include "config.h"
-#include "violet/all.h"
+#include "core.h"
 #include "action.h"
 #include "types.h"
+#include "disk.h"
+#include "map.h"
+
+/*
+ * Compiled map pack (.cmap) layout, little-endian:
+ *   struct cmap_header
+ *   u32 offsets[num_maps]     (byte offset of each record from file start)
+ *   num_maps records, each 4-byte aligned:
+ *     struct cmap_record
+ *     u8 tiles[height][width]
+ */
+
+#define CMAP_MAGIC "CMAP"
+#define CMAP_VERSION 3
+
+struct cmap_header {
+	char magic[4];
+	u32 version;
+	u32 num_maps;
+	u32 record_size;
+};
+
+struct cmap_record {
+	char desc[MAP_TIP_MAX];
+	char tip[MAP_TIP_MAX];
+	u16 width;
+	u16 height;
+	u8 actor_controlled_by_player[ACTOR_CNT_MAX];
+};
+
+/*
+ * Asset archive (.pak) layout, little-endian:
+ *   struct pak_header
+ *   struct pak_entry entries[num_entries]   (sorted by name)
+ *   entry data, each PAK_ALIGN-byte aligned
+ * Images are stored decoded, as width * height RGBA pixels, so the game
+ * can upload them straight from the mapping.
+ */
+
+#define PAK_MAGIC "CPAK"
+#define PAK_VERSION 1
+#define PAK_NAME_MAX 64
+#define PAK_ALIGN 16
+
+struct pak_header {
+	char magic[4];
+	u32 version;
+	u32 num_entries;
+	u32 entry_size;
+};
+
+struct pak_entry {
+	char name[PAK_NAME_MAX];
+	u32 offset;
+	u32 size;
+	u32 width;
+	u32 height;
+};
+
+/*
+ * Replay log (.replay) layout, little-endian:
+ *   struct replay_header
+ *   num_runs runs, each:
+ *     struct replay_run_header
+ *     struct sim_input inputs[num_inputs]
+ */
+
+#define REPLAY_MAGIC "CRPL"
+#define REPLAY_VERSION 2
+
+struct replay_header {
+	char magic[4];
+	u32 version;
+	u32 num_runs;
+};
+
+struct replay_run_header {
+	char maps_file_name[128];
+	u32 level_idx;
+	u32 num_players;
+	u32 num_inputs;
+};
+
+static
+u32 cmap__record_size(u32 width, u32 height)
+{
+	return (sizeof(struct cmap_record) + width * height + 3) & ~3u;
+}
 
 /* TODO: handle invalid map data */
-b32 load_maps(const char *filename, array(struct map) *maps)
+static
+b32 vson__read_map(FILE *fp, struct map *map)
+{
+	u32 num_actors = 0;
+	char row[MAP_DIM_MAX + 2];
+	v2i dim;
+	if (!vson_read_str(fp, "desc", map->desc, MAP_TIP_MAX))
+		return false;
+	if (!vson_read_str(fp, "tip", map->tip, MAP_TIP_MAX))
+		return false;
+	if (!vson_read_s32(fp, "width", &dim.x))
+		return false;
+	if (!vson_read_s32(fp, "height", &dim.y))
+		return false;
+	if (   dim.x < 0 || dim.x > MAP_DIM_MAX
+	    || dim.y < 0 || dim.y > MAP_DIM_MAX)
+		return false;
+	map_init(map, dim);
+	for (s32 i = 0; i < map->dim.y; ++i) {
+		fgets(row, sizeof(row), fp);
+		for (s32 j = 0; j < map->dim.x; ++j) {
+			map_set_tile_type(map, map->dim.y - i - 1, j, row[j] - '0');
+			if (row[j] - '0' == TILE_ACTOR)
+				++num_actors;
+		}
+	}
+	fgets(row, sizeof(row), fp);
+	for (u32 i = 0; i < num_actors; ++i)
+		map->actor_controlled_by_player[i] = row[i] - '0';
+	return true;
+}
+
+/* False if there was no line left, the last may lack its newline */
+static
+b32 vson__skip_line(FILE *fp)
+{
+	int c = fgetc(fp);
+	if (c == EOF)
+		return false;
+	while (c != EOF && c != '\n')
+		c = fgetc(fp);
+	return true;
+}
+
+/* Reads only the entry header to find where the next entry begins */
+static
+b32 vson__skip_map(FILE *fp)
+{
+	char buf[MAP_TIP_MAX];
+	s32 width, height;
+	if (!vson_read_str(fp, "desc", buf, MAP_TIP_MAX))
+		return false;
+	if (!vson_read_str(fp, "tip", buf, MAP_TIP_MAX))
+		return false;
+	if (!vson_read_s32(fp, "width", &width))
+		return false;
+	if (!vson_read_s32(fp, "height", &height))
+		return false;
+	for (s32 i = 0; i < height + 1; ++i)
+		if (!vson__skip_line(fp))
+			return false;
+	return !ferror(fp);
+}
+
+b32 load_maps_vson(const char *filename, array(struct map) *maps)
 {
 	b32 success = false;
 	u32 i = 0, n = 0;
 	FILE *fp;
 
-	array_clear(*maps);
+	map_array_clear(maps);
 
 	fp = fopen(filename, "r");
 	if (!fp)
@@ -20,40 +179,523 @@ b32 load_maps(const char *filename, array(struct map) *maps)
 		goto out;
 
 	for (i = 0; i < n; ++i) {
-		struct map map;
-		u32 num_actors = 0;
-		char row[MAP_DIM_MAX + 1];
-		if (!vson_read_str(fp, "desc", map.desc, MAP_TIP_MAX))
-			goto out;
-		if (!vson_read_str(fp, "tip", map.tip, MAP_TIP_MAX))
-			goto out;
-		if (!vson_read_s32(fp, "width", &map.dim.x))
-			goto out;
-		if (!vson_read_s32(fp, "height", &map.dim.y))
+		struct map map = { 0 };
+		if (!vson__read_map(fp, &map)) {
+			map_destroy(&map);
 			goto out;
-		for (s32 i = 0; i < map.dim.y; ++i) {
-			fgets(row, sizeof(row), fp);
-			for (s32 j = 0; j < map.dim.x; ++j) {
-				map.tiles[map.dim.y - i - 1][j].type = row[j] - '0';
-				if (row[j] - '0' == TILE_ACTOR)
-					++num_actors;
-			}
 		}
-		fgets(row, sizeof(row), fp);
-		for (u32 i = 0; i < num_actors; ++i)
-			map.actor_controlled_by_player[i] = row[i] - '0';
 		array_append(*maps, map);
 	}
 	success = true;
 
 out:
 	if (!success) {
-		array_clear(*maps);
+		map_array_clear(maps);
 		log_error("map load error near entry %u/%u", i, n);
 	}
+	fclose(fp);
+	return success;
+}
+
+static
+const u8 *disk__map_file(const char *filename, size_t *size)
+{
+#ifdef DISK_MMAP
+	struct stat st;
+	void *data;
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		return NULL;
+	}
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+		return NULL;
+	*size = st.st_size;
+	return data;
+#else
+	/* no mmap on the web build - a single read is the next best thing */
+	u8 *data;
+	long sz;
+	FILE *fp = fopen(filename, "rb");
+	if (!fp)
+		return NULL;
+	if (   fseek(fp, 0, SEEK_END) != 0
+	    || (sz = ftell(fp)) <= 0
+	    || fseek(fp, 0, SEEK_SET) != 0) {
+		fclose(fp);
+		return NULL;
+	}
+	data = malloc(sz);
+	if (data && fread(data, 1, sz, fp) != (size_t)sz) {
+		free(data);
+		data = NULL;
+	}
+	fclose(fp);
+	*size = sz;
+	return data;
+#endif
+}
+
+static
+void disk__unmap_file(const u8 *data, size_t size)
+{
+#ifdef DISK_MMAP
+	munmap((void*)data, size);
+#else
+	free((void*)data);
+#endif
+}
+
+/* The mounted archive, shared read-only by every thread once mounted */
+static const u8 *g_archive = NULL;
+static size_t g_archive_size = 0;
+static char g_archive_filename[256];
+
+static
+b32 pak__valid(const u8 *data, size_t size)
+{
+	const struct pak_header *header = (const struct pak_header*)data;
+	const struct pak_entry *entries = (const struct pak_entry*)(header + 1);
+
+	if (   size < sizeof(*header)
+	    || memcmp(header->magic, PAK_MAGIC, 4) != 0
+	    || header->version != PAK_VERSION
+	    || header->entry_size != sizeof(struct pak_entry)
+	    || (size - sizeof(*header)) / sizeof(struct pak_entry) < header->num_entries)
+		return false;
+
+	for (u32 i = 0; i < header->num_entries; ++i) {
+		const struct pak_entry *entry = &entries[i];
+		if (   entry->name[PAK_NAME_MAX - 1] != '\0'
+		    || entry->offset > size
+		    || size - entry->offset < entry->size
+		    || (u64)entry->width * entry->height * 4 > entry->size
+		    || (i > 0 && strcmp(entries[i-1].name, entry->name) >= 0))
+			return false;
+	}
+	return true;
+}
+
+static
+const struct pak_entry *pak__find(const char *name)
+{
+	const struct pak_header *header = (const struct pak_header*)g_archive;
+	const struct pak_entry *entries = (const struct pak_entry*)(header + 1);
+	u32 lo = 0, hi;
+
+	if (!g_archive)
+		return NULL;
+
+	hi = header->num_entries;
+	while (lo < hi) {
+		const u32 mid = lo + (hi - lo) / 2;
+		const int cmp = strcmp(entries[mid].name, name);
+		if (cmp == 0)
+			return &entries[mid];
+		else if (cmp < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return NULL;
+}
+
+/* Assets found in the archive are served from it in place of loose files */
+b32 archive_mount(const char *filename)
+{
+	archive_unmount();
+
+	g_archive = disk__map_file(filename, &g_archive_size);
+	if (!g_archive)
+		return false;
+
+	if (!pak__valid(g_archive, g_archive_size)) {
+		log_error("asset archive index error in %s", filename);
+		archive_unmount();
+		return false;
+	}
+	strncpy(g_archive_filename, filename, sizeof(g_archive_filename) - 1);
+	return true;
+}
+
+void archive_unmount(void)
+{
+	if (g_archive)
+		disk__unmap_file(g_archive, g_archive_size);
+	g_archive = NULL;
+	g_archive_size = 0;
+	g_archive_filename[0] = '\0';
+}
+
+const void *archive_find(const char *name, u32 *size)
+{
+	const struct pak_entry *entry = pak__find(name);
+	if (!entry)
+		return NULL;
+	*size = entry->size;
+	return g_archive + entry->offset;
+}
+
+const u8 *archive_find_image(const char *name, v2i *dim)
+{
+	const struct pak_entry *entry = pak__find(name);
+	if (!entry || entry->width == 0 || entry->height == 0)
+		return NULL;
+	*dim = (v2i){ .x = entry->width, .y = entry->height };
+	return g_archive + entry->offset;
+}
+
+static
+b32 cmap__decode_record(const struct cmap_record *rec, struct map *map)
+{
+	const u8 *tiles = (const u8*)(rec + 1);
+	u32 num_actors = 0;
+
+	if (rec->width > MAP_DIM_MAX || rec->height > MAP_DIM_MAX)
+		return false;
+
+	memcpy(map->desc, rec->desc, MAP_TIP_MAX);
+	map->desc[MAP_TIP_MAX - 1] = '\0';
+	memcpy(map->tip, rec->tip, MAP_TIP_MAX);
+	map->tip[MAP_TIP_MAX - 1] = '\0';
+	map_init(map, (v2i){ .x = rec->width, .y = rec->height });
+	for (s32 i = 0; i < map->dim.y; ++i) {
+		for (s32 j = 0; j < map->dim.x; ++j) {
+			const u8 type = tiles[i * map->dim.x + j];
+			if (type >= TILE_CNT)
+				return false;
+			map_set_tile_type(map, i, j, type);
+			if (type == TILE_ACTOR)
+				++num_actors;
+		}
+	}
+	if (num_actors > ACTOR_CNT_MAX)
+		return false;
+	for (u32 i = 0; i < num_actors; ++i)
+		map->actor_controlled_by_player[i] = rec->actor_controlled_by_player[i];
+	return true;
+}
+
+static
+b32 cmap__valid(const u8 *data, size_t size)
+{
+	const struct cmap_header *header = (const struct cmap_header*)data;
+	const u32 *offsets = (const u32*)(header + 1);
+
+	if (   size < sizeof(*header)
+	    || memcmp(header->magic, CMAP_MAGIC, 4) != 0
+	    || header->version != CMAP_VERSION
+	    || header->record_size != sizeof(struct cmap_record)
+	    || header->num_maps == 0
+	    || (size - sizeof(*header)) / sizeof(u32) < header->num_maps)
+		return false;
+
+	for (u32 i = 0; i < header->num_maps; ++i) {
+		const struct cmap_record *rec = (const struct cmap_record*)(data + offsets[i]);
+		if (   offsets[i] % 4 != 0
+		    || offsets[i] > size
+		    || size - offsets[i] < sizeof(struct cmap_record)
+		    || size - offsets[i] < rec->width * rec->height + sizeof(*rec))
+			return false;
+	}
+	return true;
+}
+
+static
+const struct cmap_record *cmap__record(const u8 *data, u32 idx)
+{
+	const struct cmap_header *header = (const struct cmap_header*)data;
+	const u32 *offsets = (const u32*)(header + 1);
+	return (const struct cmap_record*)(data + offsets[idx]);
+}
+
+static
+b32 cmap__load(const u8 *data, size_t size, array(struct map) *maps)
+{
+	b32 success = false;
+	u32 i = 0;
+
+	map_array_clear(maps);
+
+	if (!cmap__valid(data, size))
+		goto out;
+
+	for (i = 0; i < ((const struct cmap_header*)data)->num_maps; ++i) {
+		struct map map = { 0 };
+		if (!cmap__decode_record(cmap__record(data, i), &map)) {
+			map_destroy(&map);
+			goto out;
+		}
+		array_append(*maps, map);
+	}
+	success = true;
+
+out:
+	if (!success) {
+		map_array_clear(maps);
+		log_error("compiled map load error near entry %u", i);
+	}
 	return success;
 }
 
+b32 load_maps_cmap(const char *filename, array(struct map) *maps)
+{
+	b32 success;
+	const u8 *data;
+	size_t size;
+
+	map_array_clear(maps);
+
+	data = disk__map_file(filename, &size);
+	if (!data)
+		return false;
+
+	success = cmap__load(data, size, maps);
+	disk__unmap_file(data, size);
+	return success;
+}
+
+/* foo.vson -> foo.cmap */
+static
+b32 disk__compiled_filename(const char *filename, char *compiled, u32 n)
+{
+	const char *ext = strrchr(filename, '.');
+	const u32 stem = ext ? ext - filename : strlen(filename);
+	if (stem + 6 > n)
+		return false;
+	memcpy(compiled, filename, stem);
+	strcpy(compiled + stem, ".cmap");
+	return true;
+}
+
+static
+b32 disk__file_newer_or_same(const char *filename, const char *other)
+{
+	struct stat st, st_other;
+	if (stat(filename, &st) != 0)
+		return false;
+	if (stat(other, &st_other) != 0)
+		return true;
+	return st.st_mtime >= st_other.st_mtime;
+}
+
+/* Picks the compiled pack for a source file unless the source is newer */
+static
+const char *disk__resolve_filename(const char *filename, char *compiled, u32 n)
+{
+	const char *ext = strrchr(filename, '.');
+
+	if (ext && strcmp(ext, ".cmap") == 0)
+		return filename;
+
+	if (   disk__compiled_filename(filename, compiled, n)
+	    && disk__file_newer_or_same(compiled, filename))
+		return compiled;
+
+	return filename;
+}
+
+static
+b32 disk__is_cmap(const char *filename)
+{
+	const char *ext = strrchr(filename, '.');
+	return ext && strcmp(ext, ".cmap") == 0;
+}
+
+/* The compiled form of a pack, if the mounted archive has it and the
+ * source hasn't been saved since, as with disk__resolve_filename */
+static
+const u8 *disk__archived_cmap(const char *filename, size_t *size)
+{
+	char compiled[256];
+	const u8 *data;
+	u32 sz;
+
+	if (!g_archive || !disk__file_newer_or_same(g_archive_filename, filename))
+		return NULL;
+	if (!disk__compiled_filename(filename, B2PS(compiled)))
+		return NULL;
+	data = archive_find(compiled, &sz);
+	*size = sz;
+	return data;
+}
+
+b32 load_maps(const char *filename, array(struct map) *maps)
+{
+	char compiled[256];
+	const char *resolved = disk__resolve_filename(filename, B2PS(compiled));
+	size_t size;
+	const u8 *archived = disk__archived_cmap(filename, &size);
+
+	if (archived && cmap__load(archived, size, maps))
+		return true;
+	if (disk__is_cmap(resolved) && load_maps_cmap(resolved, maps))
+		return true;
+	return load_maps_vson(filename, maps);
+}
+
+static
+void map_pack__reset(struct map_pack *pack)
+{
+	pack->maps = NULL;
+	pack->fp = NULL;
+	pack->data = NULL;
+	pack->size = 0;
+	pack->data_owned = false;
+	pack->offsets = NULL;
+	pack->clock = 0;
+	for (u32 i = 0; i < MAP_CACHE_CNT; ++i) {
+		pack->cache[i].idx = ~0;
+		pack->cache[i].last_used = 0;
+	}
+}
+
+static
+b32 map_pack__open_vson(struct map_pack *pack, const char *filename)
+{
+	u32 n = 0;
+
+	pack->fp = fopen(filename, "r");
+	if (!pack->fp)
+		return false;
+
+	if (!vson_read_u32(pack->fp, "maps", &n) || n == 0)
+		goto err;
+
+	pack->offsets = array_create();
+	for (u32 i = 0; i < n; ++i) {
+		const u32 offset = ftell(pack->fp);
+		if (!vson__skip_map(pack->fp))
+			goto err;
+		array_append(pack->offsets, offset);
+	}
+	return true;
+
+err:
+	log_error("map index error in %s", filename);
+	map_pack_close(pack);
+	return false;
+}
+
+static
+b32 map_pack__open_cmap(struct map_pack *pack, const char *filename)
+{
+	pack->data = disk__map_file(filename, &pack->size);
+	if (!pack->data)
+		return false;
+	pack->data_owned = true;
+	if (!cmap__valid(pack->data, pack->size)) {
+		log_error("compiled map index error in %s", filename);
+		map_pack_close(pack);
+		return false;
+	}
+	return true;
+}
+
+b32 map_pack_open(struct map_pack *pack, const char *filename)
+{
+	char compiled[256];
+	const char *resolved = disk__resolve_filename(filename, B2PS(compiled));
+
+	map_pack_close(pack);
+
+	pack->data = disk__archived_cmap(filename, &pack->size);
+	if (pack->data && cmap__valid(pack->data, pack->size))
+		return true;
+	map_pack__reset(pack);
+
+	if (disk__is_cmap(resolved) && map_pack__open_cmap(pack, resolved))
+		return true;
+	return map_pack__open_vson(pack, filename);
+}
+
+void map_pack_open_maps(struct map_pack *pack, array(struct map) *maps)
+{
+	map_pack_close(pack);
+	pack->maps = maps;
+}
+
+void map_pack_close(struct map_pack *pack)
+{
+	if (pack->fp)
+		fclose(pack->fp);
+	if (pack->data && pack->data_owned)
+		disk__unmap_file(pack->data, pack->size);
+	if (pack->offsets)
+		array_destroy(pack->offsets);
+	for (u32 i = 0; i < MAP_CACHE_CNT; ++i)
+		map_destroy(&pack->cache[i].map);
+	map_pack__reset(pack);
+}
+
+u32 map_pack_sz(const struct map_pack *pack)
+{
+	if (pack->maps)
+		return array_sz(*pack->maps);
+	else if (pack->data)
+		return ((const struct cmap_header*)pack->data)->num_maps;
+	else if (pack->offsets)
+		return array_sz(pack->offsets);
+	else
+		return 0;
+}
+
+static
+b32 map_pack__decode(struct map_pack *pack, u32 idx, struct map *map)
+{
+	if (pack->data)
+		return cmap__decode_record(cmap__record(pack->data, idx), map);
+	return    fseek(pack->fp, pack->offsets[idx], SEEK_SET) == 0
+	       && vson__read_map(pack->fp, map);
+}
+
+const struct map *map_pack_get(struct map_pack *pack, u32 idx)
+{
+	static const struct map map_empty = { 0 };
+	struct map_cache_entry *entry = &pack->cache[0];
+
+	if (pack->maps)
+		return &(*pack->maps)[idx];
+
+	assert(idx < map_pack_sz(pack));
+
+	for (u32 i = 0; i < MAP_CACHE_CNT; ++i) {
+		if (pack->cache[i].idx == idx) {
+			pack->cache[i].last_used = ++pack->clock;
+			return &pack->cache[i].map;
+		}
+		if (pack->cache[i].last_used < entry->last_used)
+			entry = &pack->cache[i];
+	}
+
+	map_destroy(&entry->map);
+	if (!map_pack__decode(pack, idx, &entry->map)) {
+		log_error("map decode error for entry %u", idx);
+		map_destroy(&entry->map);
+		entry->idx = ~0;
+		entry->last_used = 0;
+		return &map_empty;
+	}
+	entry->idx = idx;
+	entry->last_used = ++pack->clock;
+	return &entry->map;
+}
+
+void map_pack_prefetch(struct map_pack *pack, u32 idx)
+{
+	const u32 n = map_pack_sz(pack);
+	if (n > 1 && !pack->maps) {
+		map_pack_get(pack, (idx + 1) % n);
+		map_pack_get(pack, (idx + n - 1) % n);
+		/* keep the current map most recently used */
+		map_pack_get(pack, idx);
+	}
+}
+
 void save_maps(const char *filename, array(const struct map) maps)
 {
 	FILE *fp = fopen(filename, "w");
@@ -71,8 +713,9 @@ void save_maps(const char *filename, array(const struct map) maps)
 		vson_write_s32(fp, "height", map->dim.y);
 		for (s32 i = 0; i < map->dim.y; ++i) {
 			for (s32 j = 0; j < map->dim.x; ++j) {
-				fputc(map->tiles[map->dim.y - i - 1][j].type + '0', fp);
-				if (map->tiles[map->dim.y - i - 1][j].type == TILE_ACTOR)
+				const enum tile_type type = map_tile_type(map, map->dim.y - i - 1, j);
+				fputc(type + '0', fp);
+				if (type == TILE_ACTOR)
 					++num_actors;
 			}
 			fputc('\n', fp);
@@ -84,3 +727,233 @@ void save_maps(const char *filename, array(const struct map) maps)
 	fclose(fp);
 }
 
+b32 save_maps_cmap(const char *filename, array(const struct map) maps)
+{
+	struct cmap_header header = {
+		.magic = CMAP_MAGIC,
+		.version = CMAP_VERSION,
+		.num_maps = array_sz(maps),
+		.record_size = sizeof(struct cmap_record),
+	};
+	u32 offset = sizeof(header) + array_sz(maps) * sizeof(u32);
+	array(u8) tiles = array_create();
+	b32 success = true;
+	FILE *fp;
+
+	fp = fopen(filename, "wb");
+	if (!fp) {
+		log_error("Failed to open compiled map file");
+		array_destroy(tiles);
+		return false;
+	}
+
+	success &= fwrite(&header, sizeof(header), 1, fp) == 1;
+	array_foreach(maps, const struct map, map) {
+		success &= fwrite(&offset, sizeof(offset), 1, fp) == 1;
+		offset += cmap__record_size(map->dim.x, map->dim.y);
+	}
+
+	array_foreach(maps, const struct map, map) {
+		const u32 size = cmap__record_size(map->dim.x, map->dim.y);
+		struct cmap_record rec = { 0 };
+		u32 num_actors = 0;
+		strncpy(rec.desc, map->desc, MAP_TIP_MAX - 1);
+		strncpy(rec.tip, map->tip, MAP_TIP_MAX - 1);
+		rec.width = map->dim.x;
+		rec.height = map->dim.y;
+		array_clear(tiles);
+		for (s32 i = 0; i < map->dim.y; ++i) {
+			for (s32 j = 0; j < map->dim.x; ++j) {
+				const u8 type = map_tile_type(map, i, j);
+				array_append(tiles, type);
+				if (type == TILE_ACTOR)
+					++num_actors;
+			}
+		}
+		while (sizeof(rec) + array_sz(tiles) < size)
+			array_append(tiles, 0);
+		for (u32 i = 0; i < num_actors; ++i)
+			rec.actor_controlled_by_player[i] = map->actor_controlled_by_player[i];
+		success &= fwrite(&rec, sizeof(rec), 1, fp) == 1;
+		if (array_sz(tiles) > 0)
+			success &= fwrite(tiles, array_sz(tiles), 1, fp) == 1;
+	}
+
+	fclose(fp);
+	array_destroy(tiles);
+	if (!success)
+		log_error("Failed to write compiled map file");
+	return success;
+}
+
+static
+int pak__file_cmp(const void *lhs, const void *rhs)
+{
+	return strcmp((*(const struct archive_file *const*)lhs)->name,
+	              (*(const struct archive_file *const*)rhs)->name);
+}
+
+b32 save_archive(const char *filename, const struct archive_file files[], u32 n)
+{
+	static const u8 padding[PAK_ALIGN] = { 0 };
+	const struct pak_header header = {
+		.magic = PAK_MAGIC,
+		.version = PAK_VERSION,
+		.num_entries = n,
+		.entry_size = sizeof(struct pak_entry),
+	};
+	const struct archive_file **sorted = malloc(n * sizeof(*sorted));
+	u32 offset = sizeof(header) + n * sizeof(struct pak_entry);
+	b32 success = true;
+	FILE *fp = NULL;
+
+	for (u32 i = 0; i < n; ++i)
+		sorted[i] = &files[i];
+	qsort(sorted, n, sizeof(*sorted), pak__file_cmp);
+	for (u32 i = 0; i < n; ++i) {
+		if (strlen(sorted[i]->name) >= PAK_NAME_MAX) {
+			log_error("Archive name too long: %s", sorted[i]->name);
+			success = false;
+		} else if (i > 0 && strcmp(sorted[i-1]->name, sorted[i]->name) == 0) {
+			log_error("Archive name repeated: %s", sorted[i]->name);
+			success = false;
+		}
+	}
+	if (!success)
+		goto out;
+
+	fp = fopen(filename, "wb");
+	if (!fp) {
+		log_error("Failed to open archive file");
+		success = false;
+		goto out;
+	}
+
+	success &= fwrite(&header, sizeof(header), 1, fp) == 1;
+	for (u32 i = 0; i < n; ++i) {
+		struct pak_entry entry = { 0 };
+		offset = (offset + PAK_ALIGN - 1) / PAK_ALIGN * PAK_ALIGN;
+		strcpy(entry.name, sorted[i]->name);
+		entry.offset = offset;
+		entry.size = sorted[i]->size;
+		entry.width = sorted[i]->dim.x;
+		entry.height = sorted[i]->dim.y;
+		success &= fwrite(&entry, sizeof(entry), 1, fp) == 1;
+		offset += entry.size;
+	}
+
+	offset = sizeof(header) + n * sizeof(struct pak_entry);
+	for (u32 i = 0; i < n; ++i) {
+		const u32 pad = (PAK_ALIGN - offset % PAK_ALIGN) % PAK_ALIGN;
+		if (pad > 0)
+			success &= fwrite(padding, pad, 1, fp) == 1;
+		if (sorted[i]->size > 0)
+			success &= fwrite(sorted[i]->data, sorted[i]->size, 1, fp) == 1;
+		offset += pad + sorted[i]->size;
+	}
+
+	success &= fclose(fp) == 0;
+	if (!success)
+		log_error("Failed to write archive file");
+
+out:
+	free(sorted);
+	return success;
+}
+
+b32 save_replay(const char *filename, array(const struct replay_run) runs)
+{
+	const struct replay_header header = {
+		.magic = REPLAY_MAGIC,
+		.version = REPLAY_VERSION,
+		.num_runs = array_sz(runs),
+	};
+	b32 success = true;
+	FILE *fp;
+
+	fp = fopen(filename, "wb");
+	if (!fp) {
+		log_error("Failed to open replay file");
+		return false;
+	}
+
+	success &= fwrite(&header, sizeof(header), 1, fp) == 1;
+	array_foreach(runs, const struct replay_run, run) {
+		struct replay_run_header rec = {
+			.level_idx = run->level_idx,
+			.num_players = run->num_players,
+			.num_inputs = array_sz(run->inputs),
+		};
+		memcpy(rec.maps_file_name, run->maps_file_name, sizeof(rec.maps_file_name));
+		success &= fwrite(&rec, sizeof(rec), 1, fp) == 1;
+		if (rec.num_inputs > 0)
+			success &= fwrite(run->inputs, sizeof(struct sim_input), rec.num_inputs, fp)
+			           == rec.num_inputs;
+	}
+
+	fclose(fp);
+	if (!success)
+		log_error("Failed to write replay file");
+	return success;
+}
+
+b32 load_replay(const char *filename, array(struct replay_run) *runs)
+{
+	b32 success = false;
+	struct replay_header header;
+	u32 i = 0;
+	FILE *fp;
+
+	replay_clear(runs);
+
+	fp = fopen(filename, "rb");
+	if (!fp) {
+		log_error("Failed to open replay file %s", filename);
+		return false;
+	}
+
+	if (   fread(&header, sizeof(header), 1, fp) != 1
+	    || memcmp(header.magic, REPLAY_MAGIC, 4) != 0
+	    || header.version != REPLAY_VERSION)
+		goto out;
+
+	for (i = 0; i < header.num_runs; ++i) {
+		struct replay_run_header rec;
+		struct replay_run run;
+		if (fread(&rec, sizeof(rec), 1, fp) != 1)
+			goto out;
+		memcpy(run.maps_file_name, rec.maps_file_name, sizeof(run.maps_file_name));
+		run.maps_file_name[sizeof(run.maps_file_name) - 1] = '\0';
+		run.level_idx = rec.level_idx;
+		run.num_players = rec.num_players;
+		if (run.num_players == 0 || run.num_players > PLAYER_CNT_MAX)
+			goto out;
+		run.inputs = array_create();
+		array_append(*runs, run);
+		for (u32 j = 0; j < rec.num_inputs; ++j) {
+			struct sim_input input;
+			if (   fread(&input, sizeof(input), 1, fp) != 1
+			    || input.player >= run.num_players
+			    || input.action >= SIM_COMMAND_COUNT
+			    || (j > 0 && input.tick < array_last(array_last(*runs).inputs).tick))
+				goto out;
+			array_append(array_last(*runs).inputs, input);
+		}
+	}
+	success = true;
+
+out:
+	if (!success) {
+		replay_clear(runs);
+		log_error("replay load error near run %u", i);
+	}
+	fclose(fp);
+	return success;
+}
+
+void replay_clear(array(struct replay_run) *runs)
+{
+	array_foreach(*runs, struct replay_run, run)
+		array_destroy(run->inputs);
+	array_clear(*runs);
+}
@@ -1,2 +1,22 @@
 b32  load_maps(const char *filename, array(struct map) *maps);
+b32  load_maps_vson(const char *filename, array(struct map) *maps);
+b32  load_maps_cmap(const char *filename, array(struct map) *maps);
 void save_maps(const char *filename, array(const struct map) maps);
+b32  save_maps_cmap(const char *filename, array(const struct map) maps);
+
+b32  archive_mount(const char *filename);
+void archive_unmount(void);
+const void *archive_find(const char *name, u32 *size);
+const u8   *archive_find_image(const char *name, v2i *dim);
+b32  save_archive(const char *filename, const struct archive_file files[], u32 n);
+
+b32  map_pack_open(struct map_pack *pack, const char *filename);
+void map_pack_open_maps(struct map_pack *pack, array(struct map) *maps);
+void map_pack_close(struct map_pack *pack);
+u32  map_pack_sz(const struct map_pack *pack);
+const struct map *map_pack_get(struct map_pack *pack, u32 idx);
+void map_pack_prefetch(struct map_pack *pack, u32 idx);
+
+b32  save_replay(const char *filename, array(const struct replay_run) runs);
+b32  load_replay(const char *filename, array(struct replay_run) *runs);
+void replay_clear(array(struct replay_run) *runs);
@@ -4,9 +4,12 @@
 #include "action.h"
 #include "types.h"
 #include "constants.h"
+#include "theme.h"
 #include "history.h"
 #include "settings.h"
 #include "player.h"
+#include "map.h"
+#include "profile.h"
 #include "editor.h"
 
 static u32 editor_map_idx;
@@ -15,45 +18,245 @@ static struct map editor_map_orig, editor_map_cut;
 static v2i editor_cursor;
 static struct player editor_player;
 
-void editor_init(void)
+/*
+ * Bookkeeping for the map being edited, so edits never rescan the map.
+ * It is rebuilt whenever the map is replaced or resized, and kept current
+ * by editor__set_tile_type for every single-tile change in between.
+ * Positions are row-major tile indices.
+ */
+struct editor__cell
 {
-	editor_maps = NULL;
-	editor_map_idx = ~0;
-	editor_map_cut.dim = g_v2i_zero;
-	player_init(&editor_player, 0);
+	u8 floor_neighbours; /* surrounding tiles that are neither wall nor blank */
+	u8 dirty;            /* in editor__index.dirty */
+};
+
+struct editor__index
+{
+	v2i dim;
+	struct editor__cell *cells;
+	u32 *row_tiles, *col_tiles; /* non-blank tiles in each row & column */
+	u32 num_tiles;
+	v2i min, max;               /* bounding box of the non-blank tiles */
+	array(u32) dirty;           /* tiles whose border may need fixing */
+	array(u32) actors;          /* sorted */
+};
+
+static struct editor__index editor_index;
+
+/* Held keys repeat at ACTION_REPEAT_INTERVAL, using player 1's bindings */
+static
+b32 editor__desires_action(enum action action, const gui_t *gui)
+{
+	struct player *player = &editor_player;
+	const u32 frame_milli = gui_frame_time_milli(gui);
+
+	if (gui_any_widget_has_focus(gui)) {
+		return false;
+	} else if (!key_down(gui, g_key_bindings[0][action])) {
+		if (player->last_action == action)
+			player->last_action = ACTION_COUNT;
+		return false;
+	} else if (player->last_action == ACTION_COUNT) {
+		player->last_action = action;
+		player->action_repeat_timer = ACTION_REPEAT_INTERVAL;
+		return true;
+	} else if (action != player->last_action) {
+		return false;
+	} else if (player->action_repeat_timer <= frame_milli) {
+		player->action_repeat_timer =   ACTION_REPEAT_INTERVAL
+		                              - (frame_milli - player->action_repeat_timer);
+		return true;
+	} else {
+		player->action_repeat_timer -= frame_milli;
+		return false;
+	}
 }
 
 static
-void editor__init_map(struct map map)
+b32 editor__is_floor(enum tile_type type)
 {
-	static const v2i dim_max = { MAP_DIM_MAX, MAP_DIM_MAX };
-	const v2i offset = v2i_scale_inv(v2i_sub(dim_max, map.dim), 2);
-	struct map *editor_map = &(*editor_maps)[editor_map_idx];
+	return type != TILE_WALL && type != TILE_BLANK;
+}
 
-	editor_map->dim = dim_max;
+static
+void editor__mark_dirty(s32 i, s32 j)
+{
+	struct editor__index *index = &editor_index;
+	const u32 pos = i * index->dim.x + j;
+	if (!index->cells[pos].dirty) {
+		index->cells[pos].dirty = true;
+		array_append(index->dirty, pos);
+	}
+}
+
+static
+void editor__index_add(enum tile_type type, s32 i, s32 j)
+{
+	struct editor__index *index = &editor_index;
+	const u32 pos = i * index->dim.x + j;
+
+	if (type == TILE_ACTOR) {
+		u32 k = 0;
+		while (k < array_sz(index->actors) && index->actors[k] < pos)
+			++k;
+		array_insert(index->actors, k, pos);
+	}
+
+	if (editor__is_floor(type))
+		for (s32 ii = max(i - 1, 0); ii < min(i + 2, index->dim.y); ++ii)
+			for (s32 jj = max(j - 1, 0); jj < min(j + 2, index->dim.x); ++jj)
+				if (!(ii == i && jj == j))
+					++index->cells[ii * index->dim.x + jj].floor_neighbours;
+
+	if (type != TILE_BLANK) {
+		++index->row_tiles[i];
+		++index->col_tiles[j];
+		if (index->num_tiles++ == 0) {
+			index->min = (v2i){ .x = j, .y = i };
+			index->max = index->min;
+		} else {
+			index->min = (v2i){ .x = min(index->min.x, j), .y = min(index->min.y, i) };
+			index->max = (v2i){ .x = max(index->max.x, j), .y = max(index->max.y, i) };
+		}
+	}
+}
 
-	for (s32 i = 0; i < offset.y; ++i)
-		for (s32 j = 0; j < editor_map->dim.x; ++j)
-			editor_map->tiles[i][j].type = TILE_BLANK;
+static
+void editor__index_remove(enum tile_type type, s32 i, s32 j)
+{
+	struct editor__index *index = &editor_index;
+	const u32 pos = i * index->dim.x + j;
+
+	if (type == TILE_ACTOR) {
+		for (u32 k = 0; k < array_sz(index->actors); ++k) {
+			if (index->actors[k] == pos) {
+				array_remove(index->actors, k);
+				break;
+			}
+		}
+	}
+
+	if (editor__is_floor(type))
+		for (s32 ii = max(i - 1, 0); ii < min(i + 2, index->dim.y); ++ii)
+			for (s32 jj = max(j - 1, 0); jj < min(j + 2, index->dim.x); ++jj)
+				if (!(ii == i && jj == j))
+					--index->cells[ii * index->dim.x + jj].floor_neighbours;
+
+	if (type != TILE_BLANK) {
+		--index->row_tiles[i];
+		--index->col_tiles[j];
+		if (--index->num_tiles > 0) {
+			/* only a row or column emptied on the box's edge shrinks it */
+			while (index->row_tiles[index->min.y] == 0)
+				++index->min.y;
+			while (index->row_tiles[index->max.y] == 0)
+				--index->max.y;
+			while (index->col_tiles[index->min.x] == 0)
+				++index->min.x;
+			while (index->col_tiles[index->max.x] == 0)
+				--index->max.x;
+		}
+	}
+}
+
+/* Wall & blank tiles are the ones editor__cleanup_map_border may change */
+static
+void editor__index_mark(enum tile_type before, enum tile_type after, s32 i, s32 j)
+{
+	if (editor__is_floor(before) != editor__is_floor(after))
+		for (s32 ii = max(i - 1, 0); ii < min(i + 2, editor_index.dim.y); ++ii)
+			for (s32 jj = max(j - 1, 0); jj < min(j + 2, editor_index.dim.x); ++jj)
+				if (!(ii == i && jj == j))
+					editor__mark_dirty(ii, jj);
+	if (!editor__is_floor(after))
+		editor__mark_dirty(i, j);
+}
+
+static
+void editor__index_rebuild(const struct map *map)
+{
+	struct editor__index *index = &editor_index;
+	const u32 n = map->dim.x * map->dim.y;
+
+	free(index->cells);
+	free(index->row_tiles);
+	free(index->col_tiles);
+	index->dim = map->dim;
+	index->cells = calloc(max(n, 1), sizeof(struct editor__cell));
+	index->row_tiles = calloc(max(map->dim.y, 1), sizeof(u32));
+	index->col_tiles = calloc(max(map->dim.x, 1), sizeof(u32));
+	index->num_tiles = 0;
+	index->min = g_v2i_zero;
+	index->max = g_v2i_zero;
+	array_clear(index->dirty);
+	array_clear(index->actors);
+
+	for (s32 i = 0; i < map->dim.y; ++i)
+		for (s32 j = 0; j < map->dim.x; ++j)
+			editor__index_add(map_tile_type(map, i, j), i, j);
+
+	/* a map fresh off disk may not be walled in yet */
+	for (s32 i = 0; i < map->dim.y; ++i) {
+		for (s32 j = 0; j < map->dim.x; ++j) {
+			const enum tile_type type = map_tile_type(map, i, j);
+			const b32 wall_needed = index->cells[i * map->dim.x + j].floor_neighbours > 0;
+			if (   (type == TILE_BLANK && wall_needed)
+			    || (type == TILE_WALL && !wall_needed))
+				editor__mark_dirty(i, j);
+		}
+	}
+}
+
+static
+void editor__set_tile_type(struct map *map, s32 i, s32 j, enum tile_type type)
+{
+	const enum tile_type before = map_tile_type(map, i, j);
+
+	if (before == type)
+		return;
+
+	map_set_tile_type(map, i, j, type);
+	editor__index_remove(before, i, j);
+	editor__index_add(type, i, j);
+	editor__index_mark(before, type, i, j);
+}
 
-	for (s32 i = offset.y; i < offset.y + map.dim.y; ++i) {
-		for (s32 j = 0; j < offset.x; ++j)
-			editor_map->tiles[i][j].type = TILE_BLANK;
-		for (s32 j = offset.x; j < offset.x + map.dim.x; ++j)
-			editor_map->tiles[i][j] = map.tiles[i - offset.y][j - offset.x];
-		for (s32 j = offset.x + map.dim.x; j < editor_map->dim.x; ++j)
-			editor_map->tiles[i][j].type = TILE_BLANK;
+void editor_init(void)
+{
+	editor_maps = NULL;
+	editor_map_idx = ~0;
+	map_destroy(&editor_map_orig);
+	map_destroy(&editor_map_cut);
+	if (!editor_index.dirty) {
+		editor_index.dirty = array_create();
+		editor_index.actors = array_create();
 	}
+	player_init(&editor_player);
+	history_clear(&editor_player.history);
+}
 
-	for (s32 i = offset.y + map.dim.y; i < editor_map->dim.y; ++i)
-		for (s32 j = 0; j < editor_map->dim.x; ++j)
-			editor_map->tiles[i][j].type = TILE_BLANK;
+/* Room to draw walls around the map, and at least a screen's worth */
+static
+v2i editor__canvas_dim(v2i dim)
+{
+	return (v2i){
+		.x = min(max(dim.x + 2, MAP_VIEW_DIM), MAP_DIM_MAX),
+		.y = min(max(dim.y + 2, MAP_VIEW_DIM), MAP_DIM_MAX),
+	};
+}
+
+static
+void editor__init_map(struct map *map)
+{
+	const v2i dim = editor__canvas_dim(map->dim);
+	map_resize(map, dim, v2i_scale_inv(v2i_sub(dim, map->dim), 2));
+	editor__index_rebuild(map);
 }
 
 void editor_edit_map(array(struct map) *maps, u32 idx)
 {
 	const b32 changed = editor_map_idx != idx;
-	const struct map map = (*maps)[idx];
+	struct map *map = &(*maps)[idx];
 
 	editor_maps = maps;
 	editor_map_idx = idx;
@@ -61,25 +264,21 @@ void editor_edit_map(array(struct map) *maps, u32 idx)
 	editor__init_map(map);
 
 	if (changed) {
-		editor_map_orig = map;
+		/* shares every chunk until the map is edited */
+		map_copy(&editor_map_orig, map);
 
-		editor_cursor.x = MAP_DIM_MAX / 2 - 1;
-		editor_cursor.y = MAP_DIM_MAX / 2 - 1;
+		editor_cursor.x = map->dim.x / 2 - 1;
+		editor_cursor.y = map->dim.y / 2 - 1;
 
-		player_init(&editor_player, 0);
+		player_init(&editor_player);
+		history_clear(&editor_player.history);
 	}
 }
 
 static
 b32 editor__wall_needed_at_tile(const struct map *map, s32 i, s32 j)
 {
-	b32 wall_needed = false;
-	for (s32 ii = max(i - 1, 0); ii < min(i + 2, map->dim.y); ++ii)
-		for (s32 jj = max(j - 1, 0); jj < min(j + 2, map->dim.x); ++jj)
-			wall_needed |=    !(ii == i && jj == j)
-			               && map->tiles[ii][jj].type != TILE_WALL
-			               && map->tiles[ii][jj].type != TILE_BLANK;
-	return wall_needed;
+	return editor_index.cells[i * map->dim.x + j].floor_neighbours > 0;
 }
 
 static
@@ -110,19 +309,36 @@ void editor__cursor_move_to(s32 i, s32 j, u32 *num_moves_)
 		*num_moves_ = num_moves;
 }
 
+/* Stepping off the edge of the canvas grows it, up to MAP_DIM_MAX */
+static
+void editor__cursor_step(struct map *map, enum dir dir)
+{
+	const v2i cursor = v2i_add(editor_cursor, g_dir_vec[dir]);
+	const v2i shift = { .x = cursor.x < 0, .y = cursor.y < 0 };
+	const v2i grow = {
+		.x = cursor.x < 0 || cursor.x >= map->dim.x,
+		.y = cursor.y < 0 || cursor.y >= map->dim.y,
+	};
+	const v2i dim = v2i_add(map->dim, grow);
+
+	if (dim.x > MAP_DIM_MAX || dim.y > MAP_DIM_MAX)
+		return;
+
+	if (!v2i_equal(grow, g_v2i_zero)) {
+		map_resize(map, dim, shift);
+		editor__index_rebuild(map);
+	}
+	editor_cursor = v2i_add(cursor, shift);
+}
+
+/* Actors are numbered in row-major order */
 static
 u32 editor__tile_actor_idx(const struct map *map, s32 i, s32 j)
 {
+	const u32 pos = i * map->dim.x + j;
 	u32 actor_idx = 0;
-	s32 ii = 0, jj = 0;
-	while (!(ii == i && jj == j)) {
-		if (map->tiles[ii][jj].type == TILE_ACTOR)
-			++actor_idx;
-		if (++jj == MAP_DIM_MAX) {
-			++ii;
-			jj = 0;
-		}
-	}
+	while (actor_idx < array_sz(editor_index.actors) && editor_index.actors[actor_idx] < pos)
+		++actor_idx;
 	return actor_idx;
 }
 
@@ -131,32 +347,32 @@ void editor__rotate_tile_cw(struct map *map)
 {
 	const s32 i = editor_cursor.y;
 	const s32 j = editor_cursor.x;
-	switch (map->tiles[i][j].type) {
+	switch (map_tile_type(map, i, j)) {
 	case TILE_BLANK:
-		map->tiles[i][j].type = TILE_HALL;
+		editor__set_tile_type(map, i, j, TILE_HALL);
 	break;
 	case TILE_WALL:
-		map->tiles[i][j].type = TILE_HALL;
+		editor__set_tile_type(map, i, j, TILE_HALL);
 	break;
 	case TILE_HALL:
-		map->tiles[i][j].type = TILE_ACTOR;
+		editor__set_tile_type(map, i, j, TILE_ACTOR);
 		map->actor_controlled_by_player[editor__tile_actor_idx(map, i, j)] = 0;
 	break;
 	case TILE_ACTOR:;
 		const u32 actor_idx = editor__tile_actor_idx(map, i, j);
-		if (map->actor_controlled_by_player[actor_idx] == PLAYER_CNT_MAX - 1)
-			map->tiles[i][j].type = TILE_CLONE;
+		if (map->actor_controlled_by_player[actor_idx] >= PLAYER_CNT_LOCAL - 1)
+			editor__set_tile_type(map, i, j, TILE_CLONE);
 		else
 			++map->actor_controlled_by_player[actor_idx];
 	break;
 	case TILE_CLONE:
-		map->tiles[i][j].type = TILE_CLONE2;
+		editor__set_tile_type(map, i, j, TILE_CLONE2);
 	break;
 	case TILE_DOOR:
-		map->tiles[i][j].type = TILE_BLANK;
+		editor__set_tile_type(map, i, j, TILE_BLANK);
 	break;
 	case TILE_CLONE2:
-		map->tiles[i][j].type = TILE_DOOR;
+		editor__set_tile_type(map, i, j, TILE_DOOR);
 	break;
 	}
 }
@@ -166,33 +382,33 @@ void editor__rotate_tile_ccw(struct map *map)
 {
 	const s32 i = editor_cursor.y;
 	const s32 j = editor_cursor.x;
-	switch (map->tiles[i][j].type) {
+	switch (map_tile_type(map, i, j)) {
 	case TILE_BLANK:
-		map->tiles[i][j].type = TILE_DOOR;
+		editor__set_tile_type(map, i, j, TILE_DOOR);
 	break;
 	case TILE_WALL:
-		map->tiles[i][j].type = TILE_BLANK;
+		editor__set_tile_type(map, i, j, TILE_BLANK);
 	break;
 	case TILE_HALL:
-		map->tiles[i][j].type = TILE_BLANK;
+		editor__set_tile_type(map, i, j, TILE_BLANK);
 	break;
 	case TILE_ACTOR:;
 		const u32 actor_idx = editor__tile_actor_idx(map, i, j);
 		if (map->actor_controlled_by_player[actor_idx] == 0)
-			map->tiles[i][j].type = TILE_HALL;
+			editor__set_tile_type(map, i, j, TILE_HALL);
 		else
 			--map->actor_controlled_by_player[actor_idx];
 	break;
 	case TILE_CLONE:
-		map->tiles[i][j].type = TILE_ACTOR;
+		editor__set_tile_type(map, i, j, TILE_ACTOR);
 		map->actor_controlled_by_player[editor__tile_actor_idx(map, i, j)]
-			= PLAYER_CNT_MAX - 1;
+			= PLAYER_CNT_LOCAL - 1;
 	break;
 	case TILE_DOOR:
-		map->tiles[i][j].type = TILE_CLONE2;
+		editor__set_tile_type(map, i, j, TILE_CLONE2);
 	break;
 	case TILE_CLONE2:
-		map->tiles[i][j].type = TILE_CLONE;
+		editor__set_tile_type(map, i, j, TILE_CLONE);
 	break;
 	}
 }
@@ -200,77 +416,83 @@ void editor__rotate_tile_ccw(struct map *map)
 static
 v2i editor__map_dim(const struct map *map, v2i *min)
 {
-	s32 min_i = MAP_DIM_MAX, min_j = MAP_DIM_MAX;
-	s32 max_i = 0, max_j = 0;
-
-	for (s32 i = 0; i < map->dim.y; ++i) {
-		for (s32 j = 0; j < map->dim.x; ++j) {
-			if (map->tiles[i][j].type != TILE_BLANK) {
-				min_i = min(min_i, i);
-				min_j = min(min_j, j);
-				max_i = max(max_i, i);
-				max_j = max(max_j, j);
-			}
-		}
+	if (editor_index.num_tiles == 0) {
+		if (min)
+			*min = map->dim;
+		return g_v2i_zero;
 	}
 
-	if (min) {
-		min->x = min_j;
-		min->y = min_i;
-	}
+	if (min)
+		*min = editor_index.min;
 	return (v2i){
-		.x = max(max_j - min_j + 1, 0),
-		.y = max(max_i - min_i + 1, 0),
+		.x = editor_index.max.x - editor_index.min.x + 1,
+		.y = editor_index.max.y - editor_index.min.y + 1,
 	};
 }
 
+static
+int editor__pos_cmp(const void *lhs_, const void *rhs_)
+{
+	const u32 lhs = *(const u32*)lhs_, rhs = *(const u32*)rhs_;
+	return lhs < rhs ? -1 : lhs > rhs;
+}
+
+/* Only visits the dirty tiles, in row-major order.  Walls & blanks leave
+ * the neighbour counts alone, so fixing one tile never dirties another. */
 static
 void editor__cleanup_map_border(struct map *map)
 {
 	const v2i orig_cursor = editor_cursor;
+	array(u32) dirty = editor_index.dirty;
 	u32 change_cnt = 0;
 
-	for (s32 i = 0; i < map->dim.y; ++i) {
-		for (s32 j = 0; j < map->dim.x; ++j) {
-			switch (map->tiles[i][j].type) {
-			case TILE_BLANK:
-				if (editor__wall_needed_at_tile(map, i, j)) {
-					u32 num_moves;
-					editor__cursor_move_to(i, j, &num_moves);
-					change_cnt += num_moves;
-
-					while (map->tiles[i][j].type != TILE_BLANK) {
-						editor__rotate_tile_cw(map);
-						history_push(&editor_player.history, ACTION_ROTATE_CW, 0);
-						++change_cnt;
-					}
-					map->tiles[i][j].type = TILE_WALL;
+	editor_index.dirty = array_create();
+	qsort(dirty, array_sz(dirty), sizeof(dirty[0]), editor__pos_cmp);
+
+	array_foreach(dirty, u32, pos) {
+		const s32 i = *pos / map->dim.x;
+		const s32 j = *pos % map->dim.x;
+		switch (map_tile_type(map, i, j)) {
+		case TILE_BLANK:
+			if (editor__wall_needed_at_tile(map, i, j)) {
+				u32 num_moves;
+				editor__cursor_move_to(i, j, &num_moves);
+				change_cnt += num_moves;
+
+				while (map_tile_type(map, i, j) != TILE_BLANK) {
+					editor__rotate_tile_cw(map);
 					history_push(&editor_player.history, ACTION_ROTATE_CW, 0);
 					++change_cnt;
 				}
-			break;
-			case TILE_WALL:
-				if (!editor__wall_needed_at_tile(map, i, j)) {
-					u32 num_moves;
-					editor__cursor_move_to(i, j, &num_moves);
-					change_cnt += num_moves;
-
-					while (map->tiles[i][j].type != TILE_BLANK) {
-						editor__rotate_tile_ccw(map);
-						history_push(&editor_player.history, ACTION_ROTATE_CCW, 0);
-						++change_cnt;
-					}
+				editor__set_tile_type(map, i, j, TILE_WALL);
+				history_push(&editor_player.history, ACTION_ROTATE_CW, 0);
+				++change_cnt;
+			}
+		break;
+		case TILE_WALL:
+			if (!editor__wall_needed_at_tile(map, i, j)) {
+				u32 num_moves;
+				editor__cursor_move_to(i, j, &num_moves);
+				change_cnt += num_moves;
+
+				while (map_tile_type(map, i, j) != TILE_BLANK) {
+					editor__rotate_tile_ccw(map);
+					history_push(&editor_player.history, ACTION_ROTATE_CCW, 0);
+					++change_cnt;
 				}
-			break;
-			case TILE_HALL:
-			case TILE_ACTOR:
-			case TILE_CLONE:
-			case TILE_CLONE2:
-			case TILE_DOOR:
-			break;
 			}
+		break;
+		case TILE_HALL:
+		case TILE_ACTOR:
+		case TILE_CLONE:
+		case TILE_CLONE2:
+		case TILE_DOOR:
+		break;
 		}
 	}
+	array_foreach(dirty, u32, pos)
+		editor_index.cells[*pos].dirty = false;
+	array_destroy(dirty);
 
 	{
 		u32 num_moves;
@@ -285,21 +507,14 @@ void editor__cleanup_map_border(struct map *map)
 static
 void editor__shrink_map(struct map *map)
 {
-	struct map map_play;
 	v2i min;
+	const v2i dim = editor__map_dim(map, &min);
 
-	map_play.dim = editor__map_dim(map, &min);
-
-	if (!v2i_equal(map_play.dim, g_v2i_zero)) {
-		for (s32 i = 0; i < map_play.dim.y; ++i)
-			for (s32 j = 0; j < map_play.dim.x; ++j)
-				map_play.tiles[i][j] = map->tiles[i + min.y][j + min.x];
-
-		map->dim = map_play.dim;
-		memcpy(map->tiles, map_play.tiles, sizeof(map_play.tiles));
-	} else {
-		map->dim = g_v2i_zero;
-	}
+	if (!v2i_equal(dim, g_v2i_zero))
+		map_resize(map, dim, v2i_scale(min, -1));
+	else
+		map_resize(map, g_v2i_zero, g_v2i_zero);
+	editor__index_rebuild(map);
 }
 
 static
@@ -312,11 +527,7 @@ void editor__restore_map(struct map *map)
 static
 b32 editor__map_is_blank(const struct map *map)
 {
-	for (s32 i = 0; i < map->dim.y; ++i)
-		for (s32 j = 0; j < map->dim.x; ++j)
-			if (map->tiles[i][j].type != TILE_BLANK)
-				return false;
-	return true;
+	return editor_index.num_tiles == 0;
 }
 
 void editor_update(gui_t *gui, u32 *map_to_play)
@@ -330,10 +541,10 @@ void editor_update(gui_t *gui, u32 *map_to_play)
 		editor__cleanup_map_border(editor_map);
 
 		{
-			static const v2i max_dim = { MAP_DIM_MAX, MAP_DIM_MAX };
 			v2i old_offset;
 			const v2i dim = editor__map_dim(editor_map, &old_offset);
-			const v2i new_offset = v2i_scale_inv(v2i_sub(max_dim, dim), 2);
+			const v2i canvas_dim = editor__canvas_dim(dim);
+			const v2i new_offset = v2i_scale_inv(v2i_sub(canvas_dim, dim), 2);
 			const v2i delta = v2i_sub(new_offset, old_offset);
 			v2i_add_eq(&editor_cursor, delta);
 		}
@@ -345,51 +556,50 @@ void editor_update(gui_t *gui, u32 *map_to_play)
 		*map_to_play = ~0;
 	}
 
-	gui_dim(gui, &screen.x, &screen.y);
-	offset = v2i_scale_inv(v2i_sub(screen, v2i_scale(editor_map->dim, TILE_SIZE)), 2);
-
 	if (gui_any_widget_has_focus(gui)) {
 	} else if (key_mod(gui, KBM_CTRL)) {
 		if (key_pressed(gui, KB_X)) {
+			map_destroy(&editor_map_cut);
 			editor_map_cut = *editor_map;
 			array_remove(*editor_maps, editor_map_idx);
 			if (editor_map_idx == array_sz(*editor_maps)) {
 				const struct map map_empty = { 0 };
 				array_append(*editor_maps, map_empty);
-			} else {
-				editor_map = &(*editor_maps)[editor_map_idx];
 			}
-			editor__init_map(*editor_map);
+			editor_map = &(*editor_maps)[editor_map_idx];
+			editor__init_map(editor_map);
 			history_clear(&editor_player.history);
 		} else if (key_pressed(gui, KB_C)) {
-			editor_map_cut = *editor_map;
+			map_copy(&editor_map_cut, editor_map);
 		} else if (   key_pressed(gui, KB_V)
 		           && !v2i_equal(editor_map_cut.dim, g_v2i_zero)) {
+			const struct map map_empty = { 0 };
 			editor__restore_map(editor_map);
 			array_insert(*editor_maps, editor_map_idx, editor_map_cut);
 			editor_map = &(*editor_maps)[editor_map_idx];
+			editor__init_map(editor_map);
 			history_clear(&editor_player.history);
-			editor_map_cut.dim = g_v2i_zero;
+			editor_map_cut = map_empty;
 		}
-	} else if (player_desires_action(&editor_player, ACTION_MOVE_UP, gui)) {
-		editor_cursor.y = min(editor_cursor.y + 1, MAP_DIM_MAX - 1);
+	} else if (editor__desires_action(ACTION_MOVE_UP, gui)) {
+		editor__cursor_step(editor_map, DIR_UP);
 		history_push(&editor_player.history, ACTION_MOVE_UP, 0);
-	} else if (player_desires_action(&editor_player, ACTION_MOVE_DOWN, gui)) {
-		editor_cursor.y = max(editor_cursor.y - 1, 0);
+	} else if (editor__desires_action(ACTION_MOVE_DOWN, gui)) {
+		editor__cursor_step(editor_map, DIR_DOWN);
 		history_push(&editor_player.history, ACTION_MOVE_DOWN, 0);
-	} else if (player_desires_action(&editor_player, ACTION_MOVE_LEFT, gui)) {
-		editor_cursor.x = max(editor_cursor.x - 1, 0);
+	} else if (editor__desires_action(ACTION_MOVE_LEFT, gui)) {
+		editor__cursor_step(editor_map, DIR_LEFT);
 		history_push(&editor_player.history, ACTION_MOVE_LEFT, 0);
-	} else if (player_desires_action(&editor_player, ACTION_MOVE_RIGHT, gui)) {
-		editor_cursor.x = min(editor_cursor.x + 1, MAP_DIM_MAX - 1);
+	} else if (editor__desires_action(ACTION_MOVE_RIGHT, gui)) {
+		editor__cursor_step(editor_map, DIR_RIGHT);
 		history_push(&editor_player.history, ACTION_MOVE_RIGHT, 0);
-	} else if (player_desires_action(&editor_player, ACTION_ROTATE_CW, gui)) {
+	} else if (editor__desires_action(ACTION_ROTATE_CW, gui)) {
 		editor__rotate_tile_cw(editor_map);
 		history_push(&editor_player.history, ACTION_ROTATE_CW, 0);
-	} else if (player_desires_action(&editor_player, ACTION_ROTATE_CCW, gui)) {
+	} else if (editor__desires_action(ACTION_ROTATE_CCW, gui)) {
 		editor__rotate_tile_ccw(editor_map);
 		history_push(&editor_player.history, ACTION_ROTATE_CCW, 0);
-	} else if (player_desires_action(&editor_player, ACTION_UNDO, gui)) {
+	} else if (editor__desires_action(ACTION_UNDO, gui)) {
 		enum action action;
 		u32 num_clones;
 		u32 remaining = 1;
@@ -422,19 +632,22 @@ void editor_update(gui_t *gui, u32 *map_to_play)
 			break;
 			case ACTION_UNDO:
 			case ACTION_RESET:
+			case ACTION_REDO:
 			case ACTION_COUNT:
 				remaining = num_clones;
 				count_moves = true;
 			break;
 			}
 		}
-	} else if (player_desires_action(&editor_player, ACTION_RESET, gui)) {
-		editor__init_map(editor_map_orig);
+	} else if (editor__desires_action(ACTION_RESET, gui)) {
+		map_copy(editor_map, &editor_map_orig);
+		editor__index_rebuild(editor_map);
 		history_clear(&editor_player.history);
 	} else if (key_pressed(gui, key_next)) {
 		editor__restore_map(editor_map);
 		if (editor_map_idx + 1 == array_sz(*editor_maps)) {
 			if (editor__map_is_blank(editor_map)) {
+				map_destroy(editor_map);
 				array_pop(*editor_maps);
 				editor_map_idx = 0;
 			} else {
@@ -447,7 +660,7 @@ void editor_update(gui_t *gui, u32 *map_to_play)
 		}
 		history_clear(&editor_player.history);
 		editor_map = &(*editor_maps)[editor_map_idx];
-		editor__init_map((*editor_maps)[editor_map_idx]);
+		editor__init_map(editor_map);
 	} else if (key_pressed(gui, key_prev)) {
 		editor__restore_map(editor_map);
 		if (editor_map_idx == 0) {
@@ -456,36 +669,46 @@ void editor_update(gui_t *gui, u32 *map_to_play)
 			array_append(*editor_maps, map_empty);
 		} else {
 			if (   editor_map_idx + 1 == array_sz(*editor_maps)
-			    && editor__map_is_blank(editor_map))
-					array_pop(*editor_maps);
+			    && editor__map_is_blank(editor_map)) {
+				map_destroy(editor_map);
+				array_pop(*editor_maps);
+			}
 			--editor_map_idx;
 		}
 		history_clear(&editor_player.history);
 		editor_map = &(*editor_maps)[editor_map_idx];
-		editor__init_map((*editor_maps)[editor_map_idx]);
+		editor__init_map(editor_map);
 	}
 
+	gui_dim(gui, &screen.x, &screen.y);
+	offset = map_view_offset(editor_map->dim, screen,
+	                         v2i_add(v2i_scale(editor_cursor, TILE_SIZE),
+	                                 (v2i){ .x = TILE_SIZE / 2, .y = TILE_SIZE / 2 }));
+
 	gui_npt(gui, 2, screen.y - TILE_SIZE + 2, screen.x - 4, TILE_SIZE - 4,
 	        editor_map->desc, MAP_TIP_MAX - 1, "description", 0);
 
 	{
-		u32 actor_idx = 0;
-		for (s32 i = 0; i < editor_map->dim.y; ++i) {
+		v2i first, last;
+		profile_begin("editor_tiles");
+		map_view_bounds(editor_map->dim, screen, offset, &first, &last);
+		for (s32 i = first.y; i < last.y; ++i) {
 			const s32 y = offset.y + i * TILE_SIZE;
-			for (s32 j = 0; j < editor_map->dim.x; ++j) {
+			for (s32 j = first.x; j < last.x; ++j) {
 				const s32 x = offset.x + j * TILE_SIZE;
-				const enum tile_type type = editor_map->tiles[i][j].type;
+				const enum tile_type type = map_tile_type(editor_map, i, j);
 				const color_t color = { .r=0x32, .g=0x2f, .b=0x2f, .a=0xff };
 				gui_rect(gui, x, y, TILE_SIZE, TILE_SIZE, g_tile_fills[type], color);
 				if (type == TILE_ACTOR) {
+					const u32 actor_idx = editor__tile_actor_idx(editor_map, i, j);
 					char buf[8];
 					sprintf(buf, "%u", editor_map->actor_controlled_by_player[actor_idx] + 1);
 					gui_txt(gui, x + TILE_SIZE / 2, y + TILE_SIZE / 2,
 					        TILE_SIZE, buf, g_white, GUI_ALIGN_MIDCENTER);
-					++actor_idx;
 				}
 			}
 		}
+		profile_end();
 	}
 
 	gui_npt(gui, 2, 2, screen.x - 4, TILE_SIZE - 4,
@@ -0,0 +1,167 @@
+#include "config.h"
+#include "violet/all.h"
+#include "action.h"
+#include "types.h"
+#include "render_types.h"
+#include "theme.h"
+#include "map.h"
+#include "floor.h"
+
+/*
+ * The HALL/DOOR geometry never changes during a level, so each chunk of the
+ * map is rasterized once into a texture and drawn with a single call.  The
+ * image covers the chunk's tiles plus the overhang below its bottom row.
+ * Pixel rows are stored top-first, as with decoded PNGs.
+ */
+
+#define FLOOR_CHUNK_W (MAP_CHUNK_DIM * TILE_SIZE)
+#define FLOOR_CHUNK_H (MAP_CHUNK_DIM * TILE_SIZE + g_tile_overhang)
+
+void floor_init(struct floor_cache *cache)
+{
+	cache->chunks = NULL;
+	cache->num_chunks = 0;
+	cache->cap = 0;
+	cache->clock = 0;
+}
+
+void floor_reset(struct floor_cache *cache)
+{
+	for (u32 i = 0; i < cache->num_chunks; ++i)
+		img_destroy(&cache->chunks[i].img);
+	cache->num_chunks = 0;
+	cache->clock = 0;
+}
+
+void floor_destroy(struct floor_cache *cache)
+{
+	floor_reset(cache);
+	free(cache->chunks);
+	floor_init(cache);
+}
+
+/* x & y are measured from the bottom-left of the chunk image, y-up */
+static
+void floor__rect(u8 *pixels, s32 x, s32 y, s32 w, s32 h, color_t color)
+{
+	const s32 x0 = max(x, 0), x1 = min(x + w, FLOOR_CHUNK_W);
+	const s32 y0 = max(y, 0), y1 = min(y + h, FLOOR_CHUNK_H);
+	for (s32 py = y0; py < y1; ++py) {
+		u8 *row = pixels + (FLOOR_CHUNK_H - 1 - py) * FLOOR_CHUNK_W * 4;
+		for (s32 px = x0; px < x1; ++px) {
+			row[px * 4 + 0] = color.r;
+			row[px * 4 + 1] = color.g;
+			row[px * 4 + 2] = color.b;
+			row[px * 4 + 3] = color.a;
+		}
+	}
+}
+
+static
+void floor__bake(const struct map *map, v2i chunk, u8 *pixels)
+{
+	const s32 o2 = g_tile_inset;
+	const s32 s2 = TILE_SIZE - 2 * o2;
+	const s32 h3 = g_tile_overhang;
+	const v2i first = v2i_scale(chunk, MAP_CHUNK_DIM);
+	const v2i last = {
+		.x = min(first.x + MAP_CHUNK_DIM, map->dim.x),
+		.y = min(first.y + MAP_CHUNK_DIM, map->dim.y),
+	};
+
+	memset(pixels, 0, FLOOR_CHUNK_W * FLOOR_CHUNK_H * 4);
+
+	for (s32 i = first.y; i < last.y; ++i) {
+		const s32 y = (i - first.y) * TILE_SIZE + h3;
+		for (s32 j = first.x; j < last.x; ++j) {
+			const s32 x = (j - first.x) * TILE_SIZE;
+			const enum tile_type type = map_tile_type(map, i, j);
+			color_t fill, fill_dark;
+
+			if (type == TILE_HALL) {
+				fill = g_grass;
+				fill_dark = g_grass_dark;
+			} else if (type == TILE_DOOR) {
+				fill = g_door;
+				fill_dark = g_door_dark;
+			} else {
+				continue;
+			}
+
+			floor__rect(pixels, x, y, TILE_SIZE, TILE_SIZE, fill);
+			floor__rect(pixels, x+o2, y+o2, s2, s2, g_stone);
+			floor__rect(pixels, x+o2, y+o2-1, s2, 3, g_stone_dark);
+			floor__rect(pixels, x+o2, y+o2, 1, s2, g_stone_dark);
+			if (i == 0 || map_tile_type(map, i-1, j) == TILE_WALL)
+				floor__rect(pixels, x, y-h3, TILE_SIZE, h3, fill_dark);
+		}
+	}
+}
+
+static
+const struct floor_chunk *floor__chunk(struct floor_cache *cache, const struct map *map,
+                                       v2i pos)
+{
+	struct floor_chunk *chunk = &cache->chunks[0];
+	u8 *pixels;
+
+	for (u32 i = 0; i < cache->num_chunks; ++i) {
+		if (v2i_equal(cache->chunks[i].pos, pos)) {
+			cache->chunks[i].last_used = ++cache->clock;
+			return &cache->chunks[i];
+		}
+		if (cache->chunks[i].last_used < chunk->last_used)
+			chunk = &cache->chunks[i];
+	}
+
+	if (cache->num_chunks < cache->cap)
+		chunk = &cache->chunks[cache->num_chunks++];
+	else
+		img_destroy(&chunk->img);
+
+	pixels = malloc(FLOOR_CHUNK_W * FLOOR_CHUNK_H * 4);
+	floor__bake(map, pos, pixels);
+	texture_init(&chunk->img.texture, FLOOR_CHUNK_W, FLOOR_CHUNK_H, GL_RGBA, pixels);
+	free(pixels);
+	chunk->pos = pos;
+	chunk->last_used = ++cache->clock;
+	return chunk;
+}
+
+void floor_draw(struct floor_cache *cache, gui_t *gui, const struct map *map,
+                v2i offset, v2i screen)
+{
+	v2i first, last;
+	u32 visible;
+
+	/* the overhang reaches below its row, so look a row past the top */
+	map_view_bounds(map->dim, v2i_add(screen, (v2i){ .x = 0, .y = g_tile_overhang }),
+	                offset, &first, &last);
+	if (first.x == last.x || first.y == last.y)
+		return;
+
+	first = v2i_scale_inv(first, MAP_CHUNK_DIM);
+	last = v2i_scale_inv(v2i_sub(last, (v2i){ .x = 1, .y = 1 }), MAP_CHUNK_DIM);
+
+	/* With room for every visible chunk, the least recently used one is
+	 * never from this frame, so no texture is destroyed before the gui
+	 * has drawn it.  Growing happens before any chunk is handed out. */
+	visible = (last.x - first.x + 1) * (last.y - first.y + 1);
+	if (visible > cache->cap) {
+		cache->cap = max(visible, FLOOR_CACHE_CNT);
+		cache->chunks = realloc(cache->chunks, cache->cap * sizeof(cache->chunks[0]));
+	}
+
+	for (s32 i = first.y; i <= last.y; ++i) {
+		for (s32 j = first.x; j <= last.x; ++j) {
+			const v2i pos = { .x = j, .y = i };
+			const struct floor_chunk *chunk;
+			if (map_chunk_blank(map, pos))
+				continue;
+			chunk = floor__chunk(cache, map, pos);
+			gui_img_ex(gui, offset.x + j * FLOOR_CHUNK_W,
+			           offset.y + i * MAP_CHUNK_DIM * TILE_SIZE - g_tile_overhang,
+			           &chunk->img, 1.f, 1.f, 1.f);
+		}
+	}
+}
@@ -0,0 +1,5 @@
+void floor_init(struct floor_cache *cache);
+void floor_reset(struct floor_cache *cache);
+void floor_destroy(struct floor_cache *cache);
+void floor_draw(struct floor_cache *cache, gui_t *gui, const struct map *map,
+                v2i offset, v2i screen);
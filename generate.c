@@ -0,0 +1,326 @@
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include "config.h"
+#include "core.h"
+#include "action.h"
+#include "types.h"
+#include "disk.h"
+#include "map.h"
+#include "solve.h"
+
+/*
+ * Samples random solo levels and keeps those the solver rates as good
+ * puzzles: solvable, no shorter than --min-steps, few distinct shortest
+ * solutions and enough choice along the way.  Workers each take the next
+ * candidate number, and a candidate's map depends only on it and the
+ * seed.  Once enough are kept no more are handed out; the lowest numbered
+ * keepers are written, so the output depends only on the arguments.
+ */
+
+struct generate__params
+{
+	u32 count;
+	u32 seed;
+	u32 num_threads;
+	u32 max_candidates;
+	s32 dim_min, dim_max;   /* inside the outer walls */
+	u32 clones_max, required_max;
+	struct solve_limits limits;
+	u32 max_shortest;       /* distinct shortest solutions */
+	r32 min_branching;
+};
+
+struct generate__puzzle
+{
+	u32 candidate;
+	u32 steps;
+	struct map map;
+};
+
+struct generate__state
+{
+	const struct generate__params *params;
+	pthread_mutex_t mutex;
+	u32 next_candidate;
+	array(struct generate__puzzle) puzzles;
+	u32 num_aborted;
+};
+
+static
+u32 generate__rand(u32 *state)
+{
+	/* xorshift32 */
+	u32 x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *state = x;
+}
+
+static
+s32 generate__rand_range(u32 *state, s32 lo, s32 hi)
+{
+	return lo + (s32)(generate__rand(state) % (u32)(hi - lo + 1));
+}
+
+static
+b32 generate__is_floor(const struct map *map, s32 i, s32 j)
+{
+	const enum tile_type type = map_tile_type(map, i, j);
+	return type != TILE_WALL && type != TILE_BLANK;
+}
+
+/* Puts a tile on a random hall inside the walls, if any are left */
+static
+b32 generate__place(struct map *map, u32 *rng, enum tile_type type)
+{
+	for (u32 tries = 0; tries < 64; ++tries) {
+		const s32 i = generate__rand_range(rng, 1, map->dim.y - 2);
+		const s32 j = generate__rand_range(rng, 1, map->dim.x - 2);
+		if (map_tile_type(map, i, j) == TILE_HALL) {
+			map_set_tile_type(map, i, j, type);
+			return true;
+		}
+	}
+	return false;
+}
+
+static
+b32 generate__sample(struct map *map, const struct generate__params *params, u32 candidate)
+{
+	u32 rng = (params->seed ^ (candidate * 2654435761u)) | 1;
+	const v2i dim = {
+		.x = generate__rand_range(&rng, params->dim_min, params->dim_max) + 2,
+		.y = generate__rand_range(&rng, params->dim_min, params->dim_max) + 2,
+	};
+	const u32 wall_pct = generate__rand_range(&rng, 5, 30);
+	const u32 num_clones = generate__rand_range(&rng, 1, params->clones_max);
+	const u32 num_required = generate__rand_range(&rng, 0, params->required_max);
+
+	memset(map, 0, sizeof(*map));
+	map_init(map, dim);
+	for (s32 i = 0; i < dim.y; ++i) {
+		for (s32 j = 0; j < dim.x; ++j) {
+			const b32 edge = i == 0 || j == 0 || i == dim.y - 1 || j == dim.x - 1;
+			const b32 wall = edge || generate__rand(&rng) % 100 < wall_pct;
+			map_set_tile_type(map, i, j, wall ? TILE_WALL : TILE_HALL);
+		}
+	}
+
+	if (!generate__place(map, &rng, TILE_ACTOR) || !generate__place(map, &rng, TILE_DOOR))
+		return false;
+	for (u32 i = 0; i < num_clones; ++i)
+		if (!generate__place(map, &rng, TILE_CLONE))
+			return false;
+	for (u32 i = 0; i < num_required; ++i)
+		if (!generate__place(map, &rng, TILE_CLONE2))
+			return false;
+
+	/* walls only where the editor would put them */
+	for (s32 i = 0; i < dim.y; ++i) {
+		for (s32 j = 0; j < dim.x; ++j) {
+			b32 needed = false;
+			if (map_tile_type(map, i, j) != TILE_WALL)
+				continue;
+			for (s32 ii = max(i - 1, 0); ii < min(i + 2, dim.y); ++ii)
+				for (s32 jj = max(j - 1, 0); jj < min(j + 2, dim.x); ++jj)
+					needed |= generate__is_floor(map, ii, jj);
+			if (!needed)
+				map_set_tile_type(map, i, j, TILE_BLANK);
+		}
+	}
+	return true;
+}
+
+static
+b32 generate__accept(const struct generate__params *params, const struct solve_stats *stats)
+{
+	return    !stats->aborted
+	       && stats->min_solution_steps != UINT_MAX
+	       && stats->num_shortest <= params->max_shortest
+	       && stats->branching >= params->min_branching;
+}
+
+static
+void *generate__worker(void *udata)
+{
+	struct generate__state *state = udata;
+	const struct generate__params *params = state->params;
+	struct solver solver;
+	struct solve_stats stats = { 0 };
+	u32 num_aborted = 0;
+
+	solver_init(&solver);
+	for (;;) {
+		struct generate__puzzle puzzle;
+
+		pthread_mutex_lock(&state->mutex);
+		if (   array_sz(state->puzzles) >= params->count
+		    || state->next_candidate >= params->max_candidates) {
+			pthread_mutex_unlock(&state->mutex);
+			break;
+		}
+		puzzle.candidate = state->next_candidate++;
+		pthread_mutex_unlock(&state->mutex);
+
+		if (!generate__sample(&puzzle.map, params, puzzle.candidate)) {
+			map_destroy(&puzzle.map);
+			continue;
+		}
+		if (   !solve(&solver, &puzzle.map, &params->limits, &stats)
+		    || !generate__accept(params, &stats)) {
+			num_aborted += stats.aborted;
+			map_destroy(&puzzle.map);
+			continue;
+		}
+
+		puzzle.steps = stats.min_solution_steps;
+		snprintf(puzzle.map.desc, MAP_TIP_MAX, "%u moves", puzzle.steps);
+		pthread_mutex_lock(&state->mutex);
+		array_append(state->puzzles, puzzle);
+		pthread_mutex_unlock(&state->mutex);
+	}
+	solver_destroy(&solver);
+
+	pthread_mutex_lock(&state->mutex);
+	state->num_aborted += num_aborted;
+	pthread_mutex_unlock(&state->mutex);
+	return NULL;
+}
+
+static
+int generate__puzzle_cmp_candidate(const void *lhs_, const void *rhs_)
+{
+	const struct generate__puzzle *lhs = lhs_, *rhs = rhs_;
+	return lhs->candidate < rhs->candidate ? -1 : lhs->candidate > rhs->candidate;
+}
+
+/* Easiest first, like the hand-made packs */
+static
+int generate__puzzle_cmp_steps(const void *lhs_, const void *rhs_)
+{
+	const struct generate__puzzle *lhs = lhs_, *rhs = rhs_;
+	if (lhs->steps != rhs->steps)
+		return lhs->steps < rhs->steps ? -1 : 1;
+	return generate__puzzle_cmp_candidate(lhs_, rhs_);
+}
+
+int main(int argc, char *const argv[])
+{
+	struct generate__params params = {
+		.count = 100,
+		.seed = 1,
+		.num_threads = max(sysconf(_SC_NPROCESSORS_ONLN), 1),
+		.max_candidates = 1000000,
+		.dim_min = 4,
+		.dim_max = 7,
+		.clones_max = 4,
+		.required_max = 2,
+		.limits = {
+			.max_states = 20000,
+			.min_steps = 10,
+			.max_steps = 30,
+			.first_solution = true,
+		},
+		.max_shortest = 2,
+		.min_branching = 1.3f,
+	};
+	struct generate__state state = { .params = &params };
+	array(struct map) maps;
+	pthread_t *threads;
+	const char *fname = NULL;
+	struct timespec start, end;
+	r64 seconds;
+	u32 num_candidates, num_puzzles;
+
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--count") == 0 && i + 1 < argc)
+			params.count = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+			params.seed = strtoul(argv[++i], NULL, 10);
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+			params.num_threads = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--candidates") == 0 && i + 1 < argc)
+			params.max_candidates = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--dim") == 0 && i + 2 < argc) {
+			params.dim_min = atoi(argv[++i]);
+			params.dim_max = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--clones") == 0 && i + 1 < argc)
+			params.clones_max = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--required") == 0 && i + 1 < argc)
+			params.required_max = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--min-steps") == 0 && i + 1 < argc)
+			params.limits.min_steps = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--max-steps") == 0 && i + 1 < argc)
+			params.limits.max_steps = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--max-states") == 0 && i + 1 < argc)
+			params.limits.max_states = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--max-shortest") == 0 && i + 1 < argc)
+			params.max_shortest = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--min-branching") == 0 && i + 1 < argc)
+			params.min_branching = atof(argv[++i]);
+		else
+			fname = argv[i];
+	}
+
+	params.num_threads = max(params.num_threads, 1);
+	params.dim_min = clamp(2, params.dim_min, MAP_DIM_MAX - 2);
+	params.dim_max = clamp(params.dim_min, params.dim_max, MAP_DIM_MAX - 2);
+	params.clones_max = max(params.clones_max, 1);
+
+	if (!fname) {
+		fprintf(stderr, "usage: %s [--count N] [--seed N] [--threads N] [--candidates N]\n"
+		                "       [--dim MIN MAX] [--clones N] [--required N]\n"
+		                "       [--min-steps N] [--max-steps N] [--max-states N]\n"
+		                "       [--max-shortest N] [--min-branching X] <maps.vson>\n",
+		        argv[0]);
+		return 1;
+	}
+	if (params.clones_max + params.required_max + 2 > (u32)(params.dim_min * params.dim_min)) {
+		fprintf(stderr, "too many clones for the smallest maps\n");
+		return 1;
+	}
+
+	pthread_mutex_init(&state.mutex, NULL);
+	state.puzzles = array_create();
+	threads = malloc(params.num_threads * sizeof(*threads));
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (u32 i = 0; i < params.num_threads; ++i)
+		pthread_create(&threads[i], NULL, generate__worker, &state);
+	for (u32 i = 0; i < params.num_threads; ++i)
+		pthread_join(threads[i], NULL);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	num_candidates = state.next_candidate;
+
+	/* candidates still running when the count was reached may be kept too */
+	qsort(state.puzzles, array_sz(state.puzzles), sizeof(state.puzzles[0]),
+	      generate__puzzle_cmp_candidate);
+	while (array_sz(state.puzzles) > params.count) {
+		map_destroy(&array_last(state.puzzles).map);
+		array_pop(state.puzzles);
+	}
+	qsort(state.puzzles, array_sz(state.puzzles), sizeof(state.puzzles[0]),
+	      generate__puzzle_cmp_steps);
+
+	maps = array_create();
+	array_foreach(state.puzzles, struct generate__puzzle, puzzle)
+		array_append(maps, puzzle->map);
+	save_maps(fname, maps);
+	num_puzzles = array_sz(maps);
+
+	printf("%u puzzles from %u candidates (%u cut short) in %.2f s on %u threads",
+	       num_puzzles, num_candidates, state.num_aborted, seconds, params.num_threads);
+	if (seconds > 0)
+		printf(", %.0f puzzles/min", num_puzzles * 60 / seconds);
+	printf("\n");
+
+	map_array_clear(&maps);
+	array_destroy(maps);
+	array_destroy(state.puzzles);
+	free(threads);
+	pthread_mutex_destroy(&state.mutex);
+	return num_puzzles < params.count;
+}
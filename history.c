@@ -1,40 +1,383 @@
 #include "config.h"
-#include "violet/all.h"
+#include "core.h"
 #include "action.h"
 #include "types.h"
 #include "history.h"
 
+/*
+ * Events are packed a byte each: the action in the low 3 bits and the
+ * number of clones it attached in the high 5.  A count that doesn't fit
+ * is written as an escape byte, the count in 4 bytes and the escape byte
+ * again, so the log can be read backwards as well as forwards.
+ *
+ * Popping only moves the present back, leaving the popped events as a
+ * redo tail.  Pushing something else sets the tail aside as a branch
+ * forking at the present, so no line of play is ever lost; switching to a
+ * branch swaps it with the tail.  Branches that forked from a tail that is
+ * set aside become its children, keeping the tree intact.
+ *
+ * Snapshots are copies of caller state taken every
+ * HISTORY_SNAPSHOT_INTERVAL events, so a jump restores the nearest one and
+ * replays at most that many events.  They move with their tail.
+ */
+
+#define HISTORY__ACTION_MASK 0x7
+#define HISTORY__GROUP 0x7 /* ACTION_COUNT, the editor's marker for grouped edits */
+#define HISTORY__CLONES_SHIFT 3
+#define HISTORY__CLONES_ESCAPE 0x1f
+#define HISTORY__ESCAPE_SZ (2 + sizeof(u32))
+
+static
+void history__reserve(void **p, u32 *cap, u32 sz, u32 elem_sz)
+{
+	if (sz > *cap) {
+		*cap = max(sz, max(*cap * 2, 64));
+		*p = realloc(*p, *cap * elem_sz);
+	}
+}
+
+static
+void history__decode(u8 byte, enum action *action)
+{
+	const u8 code = byte & HISTORY__ACTION_MASK;
+	*action = code == HISTORY__GROUP ? ACTION_COUNT : code;
+}
+
+/* Moves the redo tail, with any snapshots taken in it, into a new branch */
+static
+void history__set_tail_aside(struct history *hist)
+{
+	struct history_branch *branch;
+	u32 first_snapshot = hist->num_snapshots;
+	u32 idx;
+
+	if (hist->sz == hist->len)
+		return;
+
+	while (   first_snapshot > 0
+	       && hist->snapshots[first_snapshot - 1].num_events > hist->num_events)
+		--first_snapshot;
+
+	idx = hist->num_branches;
+	history__reserve((void**)&hist->branches, &hist->branches_cap,
+	                 hist->num_branches + 1, sizeof(struct history_branch));
+	branch = &hist->branches[hist->num_branches++];
+	branch->parent = HISTORY_BRANCH_LINE;
+	branch->num_events = hist->num_events;
+	branch->pos = hist->sz;
+	branch->len = hist->len - hist->sz;
+	branch->num_events_len = hist->num_events_len - hist->num_events;
+	branch->events = malloc(branch->len);
+	memcpy(branch->events, &hist->events[hist->sz], branch->len);
+	branch->num_snapshots = hist->num_snapshots - first_snapshot;
+	branch->snapshots = NULL;
+	branch->states = NULL;
+	branch->states_sz = 0;
+	if (branch->num_snapshots > 0) {
+		const u32 state = hist->snapshots[first_snapshot].state;
+		branch->snapshots = malloc(branch->num_snapshots * sizeof(struct history_snapshot));
+		for (u32 i = 0; i < branch->num_snapshots; ++i) {
+			const struct history_snapshot *snapshot = &hist->snapshots[first_snapshot + i];
+			branch->snapshots[i].num_events = snapshot->num_events - hist->num_events;
+			branch->snapshots[i].pos = snapshot->pos - hist->sz;
+			branch->snapshots[i].state = snapshot->state - state;
+		}
+		branch->states_sz = hist->states_sz - state;
+		branch->states = malloc(branch->states_sz);
+		memcpy(branch->states, &hist->states[state], branch->states_sz);
+		hist->states_sz = state;
+	}
+
+	for (u32 i = 0; i < idx; ++i)
+		if (   hist->branches[i].parent == HISTORY_BRANCH_LINE
+		    && hist->branches[i].num_events > hist->num_events)
+			hist->branches[i].parent = idx;
+
+	hist->num_snapshots = first_snapshot;
+	hist->len = hist->sz;
+	hist->num_events_len = hist->num_events;
+}
+
+/* Makes branch idx, which forks at the present, the redo tail */
+static
+void history__take_branch(struct history *hist, u32 idx)
+{
+	struct history_branch *branch = &hist->branches[idx];
+	const u32 last = hist->num_branches - 1;
+
+	assert(hist->sz == hist->len);
+	assert(branch->num_events == hist->num_events && branch->pos == hist->sz);
+
+	history__reserve((void**)&hist->events, &hist->cap, hist->sz + branch->len, 1);
+	memcpy(&hist->events[hist->sz], branch->events, branch->len);
+	hist->len = hist->sz + branch->len;
+	hist->num_events_len = hist->num_events + branch->num_events_len;
+
+	history__reserve((void**)&hist->snapshots, &hist->snapshots_cap,
+	                 hist->num_snapshots + branch->num_snapshots,
+	                 sizeof(struct history_snapshot));
+	history__reserve((void**)&hist->states, &hist->states_cap,
+	                 hist->states_sz + branch->states_sz, 1);
+	for (u32 i = 0; i < branch->num_snapshots; ++i) {
+		struct history_snapshot *snapshot = &hist->snapshots[hist->num_snapshots++];
+		snapshot->num_events = branch->snapshots[i].num_events + hist->num_events;
+		snapshot->pos = branch->snapshots[i].pos + hist->sz;
+		snapshot->state = branch->snapshots[i].state + hist->states_sz;
+	}
+	if (branch->states_sz > 0)
+		memcpy(&hist->states[hist->states_sz], branch->states, branch->states_sz);
+	hist->states_sz += branch->states_sz;
+
+	free(branch->events);
+	free(branch->snapshots);
+	free(branch->states);
+
+	for (u32 i = 0; i < hist->num_branches; ++i)
+		if (hist->branches[i].parent == idx)
+			hist->branches[i].parent = HISTORY_BRANCH_LINE;
+	hist->branches[idx] = hist->branches[last];
+	for (u32 i = 0; i < last; ++i)
+		if (hist->branches[i].parent == last)
+			hist->branches[i].parent = idx;
+	--hist->num_branches;
+}
+
 void history_push(struct history *hist, enum action action, u32 num_clones)
 {
-	struct history_event *event =   hist->end < HISTORY_EVENT_MAX
-	                              ? &hist->events[hist->end] : &hist->events[0];
-	event->action     = action;
-	event->num_clones = num_clones;
-	hist->end = (hist->end + 1) % HISTORY_EVENT_MAX;
-	if (hist->end == hist->begin)
-		hist->begin = (hist->begin + 1) % HISTORY_EVENT_MAX;
+	const u8 code = action == ACTION_COUNT ? HISTORY__GROUP : action;
+
+	assert(action != ACTION_UNDO && action != ACTION_REDO && action != ACTION_RESET);
+
+	history__set_tail_aside(hist);
+	history__reserve((void**)&hist->events, &hist->cap, hist->sz + HISTORY__ESCAPE_SZ, 1);
+	if (num_clones < HISTORY__CLONES_ESCAPE) {
+		hist->events[hist->sz++] = code | (num_clones << HISTORY__CLONES_SHIFT);
+	} else {
+		const u8 escape = code | (HISTORY__CLONES_ESCAPE << HISTORY__CLONES_SHIFT);
+		hist->events[hist->sz++] = escape;
+		memcpy(&hist->events[hist->sz], &num_clones, sizeof(u32));
+		hist->sz += sizeof(u32);
+		hist->events[hist->sz++] = escape;
+	}
+	hist->len = hist->sz;
+	++hist->num_events;
+	hist->num_events_len = hist->num_events;
 }
 
 b32 history_pop(struct history *hist, enum action *action, u32 *num_clones)
 {
-	if (hist->begin == hist->end) {
+	u32 cursor = hist->sz;
+	if (!history_prev(hist, &cursor, action, num_clones))
+		return false;
+	hist->sz = cursor;
+	--hist->num_events;
+	return true;
+}
+
+b32 history_redo(struct history *hist, enum action *action, u32 *num_clones)
+{
+	u32 cursor = hist->sz;
+	if (!history_next(hist, &cursor, action, num_clones))
+		return false;
+	hist->sz = cursor;
+	++hist->num_events;
+	return true;
+}
+
+/* A cursor for reading events without popping them */
+u32 history_end(const struct history *hist)
+{
+	return hist->sz;
+}
+
+/* Reads the event before the cursor and moves the cursor back over it */
+b32 history_prev(const struct history *hist, u32 *cursor, enum action *action,
+                 u32 *num_clones)
+{
+	u8 byte;
+
+	if (*cursor == 0)
+		return false;
+
+	byte = hist->events[*cursor - 1];
+	history__decode(byte, action);
+	if ((byte >> HISTORY__CLONES_SHIFT) == HISTORY__CLONES_ESCAPE) {
+		*cursor -= HISTORY__ESCAPE_SZ;
+		memcpy(num_clones, &hist->events[*cursor + 1], sizeof(u32));
+	} else {
+		--*cursor;
+		*num_clones = byte >> HISTORY__CLONES_SHIFT;
+	}
+	return true;
+}
+
+/* Reads the event after the cursor, which may be in the redo tail */
+b32 history_next(const struct history *hist, u32 *cursor, enum action *action,
+                 u32 *num_clones)
+{
+	u8 byte;
+
+	if (*cursor == hist->len)
 		return false;
-	} else if (hist->end == 0) {
-		struct history_event *event = &hist->events[HISTORY_EVENT_MAX - 1];
-		*action     = event->action;
-		*num_clones = event->num_clones;
-		hist->end = HISTORY_EVENT_MAX - 1;
-		return true;
+
+	byte = hist->events[*cursor];
+	history__decode(byte, action);
+	if ((byte >> HISTORY__CLONES_SHIFT) == HISTORY__CLONES_ESCAPE) {
+		memcpy(num_clones, &hist->events[*cursor + 1], sizeof(u32));
+		*cursor += HISTORY__ESCAPE_SZ;
 	} else {
-		struct history_event *event = &hist->events[--hist->end];
-		*action     = event->action;
-		*num_clones = event->num_clones;
-		return true;
+		*num_clones = byte >> HISTORY__CLONES_SHIFT;
+		++*cursor;
 	}
+	return true;
+}
+
+/* Changes the clone count of the last event.  The byte is rewritten in
+ * place unless a redo tail or snapshot depends on the old count, in which
+ * case the old event goes into a branch with them. */
+void history_amend(struct history *hist, u32 num_clones)
+{
+	u32 cursor = hist->sz;
+	enum action action;
+	u32 num_clones_prev;
+	b32 depended_on;
+
+	if (!history_prev(hist, &cursor, &action, &num_clones_prev))
+		return;
+
+	depended_on =    hist->sz != hist->len
+	              || (   hist->num_snapshots > 0
+	                  && hist->snapshots[hist->num_snapshots - 1].num_events == hist->num_events);
+	if (   !depended_on
+	    && num_clones < HISTORY__CLONES_ESCAPE
+	    && num_clones_prev < HISTORY__CLONES_ESCAPE) {
+		hist->events[cursor] =   (hist->events[cursor] & HISTORY__ACTION_MASK)
+		                       | (num_clones << HISTORY__CLONES_SHIFT);
+		return;
+	}
+
+	history_pop(hist, &action, &num_clones_prev);
+	if (!depended_on) {
+		hist->len = hist->sz;
+		hist->num_events_len = hist->num_events;
+	}
+	history_push(hist, action, num_clones);
+}
+
+u32 history_sz(const struct history *hist)
+{
+	return hist->num_events;
+}
+
+u32 history_len(const struct history *hist)
+{
+	return hist->num_events_len;
+}
+
+/* Back to the start, keeping everything as the redo tail */
+void history_rewind(struct history *hist)
+{
+	hist->sz = 0;
+	hist->num_events = 0;
+}
+
+u32 history_num_branches(const struct history *hist)
+{
+	u32 n = 0;
+	for (u32 i = 0; i < hist->num_branches; ++i)
+		if (   hist->branches[i].parent == HISTORY_BRANCH_LINE
+		    && hist->branches[i].num_events == hist->num_events)
+			++n;
+	return n;
+}
+
+/* Sets the redo tail aside for the oldest other branch forking here */
+b32 history_switch_branch(struct history *hist)
+{
+	for (u32 i = 0; i < hist->num_branches; ++i) {
+		if (   hist->branches[i].parent == HISTORY_BRANCH_LINE
+		    && hist->branches[i].num_events == hist->num_events) {
+			history__set_tail_aside(hist);
+			history__take_branch(hist, i);
+			return true;
+		}
+	}
+	return false;
+}
+
+static
+void history__free_branches(struct history *hist)
+{
+	for (u32 i = 0; i < hist->num_branches; ++i) {
+		free(hist->branches[i].events);
+		free(hist->branches[i].snapshots);
+		free(hist->branches[i].states);
+	}
+	hist->num_branches = 0;
 }
 
 void history_clear(struct history *hist)
 {
-	hist->begin = 0;
-	hist->end = 0;
+	history__free_branches(hist);
+	hist->sz = 0;
+	hist->len = 0;
+	hist->num_events = 0;
+	hist->num_events_len = 0;
+	hist->num_snapshots = 0;
+	hist->states_sz = 0;
+}
+
+void history_destroy(struct history *hist)
+{
+	history__free_branches(hist);
+	free(hist->events);
+	free(hist->snapshots);
+	free(hist->states);
+	free(hist->branches);
+	memset(hist, 0, sizeof(*hist));
+}
+
+b32 history_snapshot_due(const struct history *hist)
+{
+	const u32 last =   hist->num_snapshots > 0
+	                 ? hist->snapshots[hist->num_snapshots - 1].num_events : 0;
+	return hist->num_events >= last + HISTORY_SNAPSHOT_INTERVAL;
+}
+
+void history_snapshot(struct history *hist, const void *state, u32 sz)
+{
+	struct history_snapshot *snapshot;
+
+	history__reserve((void**)&hist->snapshots, &hist->snapshots_cap,
+	                 hist->num_snapshots + 1, sizeof(struct history_snapshot));
+	history__reserve((void**)&hist->states, &hist->states_cap, hist->states_sz + sz, 1);
+
+	snapshot = &hist->snapshots[hist->num_snapshots++];
+	snapshot->num_events = hist->num_events;
+	snapshot->pos = hist->sz;
+	snapshot->state = hist->states_sz;
+	memcpy(&hist->states[hist->states_sz], state, sz);
+	hist->states_sz += sz;
+}
+
+const struct history_snapshot *history_find_snapshot(const struct history *hist,
+                                                     u32 num_events)
+{
+	u32 lo = 0, hi = hist->num_snapshots;
+	while (lo < hi) {
+		const u32 mid = (lo + hi) / 2;
+		if (hist->snapshots[mid].num_events <= num_events)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo > 0 ? &hist->snapshots[lo - 1] : NULL;
+}
+
+const void *history_restore_snapshot(struct history *hist,
+                                     const struct history_snapshot *snapshot)
+{
+	hist->sz = snapshot->pos;
+	hist->num_events = snapshot->num_events;
+	return &hist->states[snapshot->state];
 }
@@ -1,3 +1,22 @@
 void history_push(struct history *hist, enum action action, u32 num_clones);
 b32  history_pop(struct history *hist, enum action *action, u32 *num_clones);
+b32  history_redo(struct history *hist, enum action *action, u32 *num_clones);
+u32  history_end(const struct history *hist);
+b32  history_prev(const struct history *hist, u32 *cursor, enum action *action,
+                  u32 *num_clones);
+b32  history_next(const struct history *hist, u32 *cursor, enum action *action,
+                  u32 *num_clones);
+void history_amend(struct history *hist, u32 num_clones);
+u32  history_sz(const struct history *hist);
+u32  history_len(const struct history *hist);
+void history_rewind(struct history *hist);
+u32  history_num_branches(const struct history *hist);
+b32  history_switch_branch(struct history *hist);
 void history_clear(struct history *hist);
+void history_destroy(struct history *hist);
+b32  history_snapshot_due(const struct history *hist);
+void history_snapshot(struct history *hist, const void *state, u32 sz);
+const struct history_snapshot *history_find_snapshot(const struct history *hist,
+                                                     u32 num_events);
+const void *history_restore_snapshot(struct history *hist,
+                                     const struct history_snapshot *snapshot);
@@ -1,3 +1,4 @@
+#include <SDL.h>
 #include "violet/all.h"
 
 b32 is_key(u32 idx)
@@ -256,3 +257,124 @@ const char *key_to_string(gui_key_t key)
 	default:                  return "<null>";
 	}
 }
+
+gui_key_t key_from_scancode(u32 scancode)
+{
+	switch (scancode) {
+	case SDL_SCANCODE_A:               return KB_A;
+	case SDL_SCANCODE_B:               return KB_B;
+	case SDL_SCANCODE_C:               return KB_C;
+	case SDL_SCANCODE_D:               return KB_D;
+	case SDL_SCANCODE_E:               return KB_E;
+	case SDL_SCANCODE_F:               return KB_F;
+	case SDL_SCANCODE_G:               return KB_G;
+	case SDL_SCANCODE_H:               return KB_H;
+	case SDL_SCANCODE_I:               return KB_I;
+	case SDL_SCANCODE_J:               return KB_J;
+	case SDL_SCANCODE_K:               return KB_K;
+	case SDL_SCANCODE_L:               return KB_L;
+	case SDL_SCANCODE_M:               return KB_M;
+	case SDL_SCANCODE_N:               return KB_N;
+	case SDL_SCANCODE_O:               return KB_O;
+	case SDL_SCANCODE_P:               return KB_P;
+	case SDL_SCANCODE_Q:               return KB_Q;
+	case SDL_SCANCODE_R:               return KB_R;
+	case SDL_SCANCODE_S:               return KB_S;
+	case SDL_SCANCODE_T:               return KB_T;
+	case SDL_SCANCODE_U:               return KB_U;
+	case SDL_SCANCODE_V:               return KB_V;
+	case SDL_SCANCODE_W:               return KB_W;
+	case SDL_SCANCODE_X:               return KB_X;
+	case SDL_SCANCODE_Y:               return KB_Y;
+	case SDL_SCANCODE_Z:               return KB_Z;
+	case SDL_SCANCODE_1:               return KB_1;
+	case SDL_SCANCODE_2:               return KB_2;
+	case SDL_SCANCODE_3:               return KB_3;
+	case SDL_SCANCODE_4:               return KB_4;
+	case SDL_SCANCODE_5:               return KB_5;
+	case SDL_SCANCODE_6:               return KB_6;
+	case SDL_SCANCODE_7:               return KB_7;
+	case SDL_SCANCODE_8:               return KB_8;
+	case SDL_SCANCODE_9:               return KB_9;
+	case SDL_SCANCODE_0:               return KB_0;
+	case SDL_SCANCODE_RETURN:          return KB_RETURN;
+	case SDL_SCANCODE_ESCAPE:          return KB_ESCAPE;
+	case SDL_SCANCODE_BACKSPACE:       return KB_BACKSPACE;
+	case SDL_SCANCODE_TAB:             return KB_TAB;
+	case SDL_SCANCODE_SPACE:           return KB_SPACE;
+	case SDL_SCANCODE_MINUS:           return KB_MINUS;
+	case SDL_SCANCODE_EQUALS:          return KB_EQUALS;
+	case SDL_SCANCODE_LEFTBRACKET:     return KB_LEFTBRACKET;
+	case SDL_SCANCODE_RIGHTBRACKET:    return KB_RIGHTBRACKET;
+	case SDL_SCANCODE_BACKSLASH:       return KB_BACKSLASH;
+	case SDL_SCANCODE_SEMICOLON:       return KB_SEMICOLON;
+	case SDL_SCANCODE_APOSTROPHE:      return KB_APOSTROPHE;
+	case SDL_SCANCODE_GRAVE:           return KB_GRAVE;
+	case SDL_SCANCODE_COMMA:           return KB_COMMA;
+	case SDL_SCANCODE_PERIOD:          return KB_PERIOD;
+	case SDL_SCANCODE_SLASH:           return KB_SLASH;
+	case SDL_SCANCODE_CAPSLOCK:        return KB_CAPSLOCK;
+	case SDL_SCANCODE_F1:              return KB_F1;
+	case SDL_SCANCODE_F2:              return KB_F2;
+	case SDL_SCANCODE_F3:              return KB_F3;
+	case SDL_SCANCODE_F4:              return KB_F4;
+	case SDL_SCANCODE_F5:              return KB_F5;
+	case SDL_SCANCODE_F6:              return KB_F6;
+	case SDL_SCANCODE_F7:              return KB_F7;
+	case SDL_SCANCODE_F8:              return KB_F8;
+	case SDL_SCANCODE_F9:              return KB_F9;
+	case SDL_SCANCODE_F10:             return KB_F10;
+	case SDL_SCANCODE_F11:             return KB_F11;
+	case SDL_SCANCODE_F12:             return KB_F12;
+	case SDL_SCANCODE_PRINTSCREEN:     return KB_PRINTSCREEN;
+	case SDL_SCANCODE_SCROLLLOCK:      return KB_SCROLLLOCK;
+	case SDL_SCANCODE_PAUSE:           return KB_PAUSE;
+	case SDL_SCANCODE_INSERT:          return KB_INSERT;
+	case SDL_SCANCODE_HOME:            return KB_HOME;
+	case SDL_SCANCODE_PAGEUP:          return KB_PAGEUP;
+	case SDL_SCANCODE_DELETE:          return KB_DELETE;
+	case SDL_SCANCODE_END:             return KB_END;
+	case SDL_SCANCODE_PAGEDOWN:        return KB_PAGEDOWN;
+	case SDL_SCANCODE_RIGHT:           return KB_RIGHT;
+	case SDL_SCANCODE_LEFT:            return KB_LEFT;
+	case SDL_SCANCODE_DOWN:            return KB_DOWN;
+	case SDL_SCANCODE_UP:              return KB_UP;
+	case SDL_SCANCODE_NUMLOCKCLEAR:    return KB_NUMLOCK_OR_CLEAR;
+	case SDL_SCANCODE_KP_DIVIDE:       return KB_KP_DIVIDE;
+	case SDL_SCANCODE_KP_MULTIPLY:     return KB_KP_MULTIPLY;
+	case SDL_SCANCODE_KP_MINUS:        return KB_KP_MINUS;
+	case SDL_SCANCODE_KP_PLUS:         return KB_KP_PLUS;
+	case SDL_SCANCODE_KP_ENTER:        return KB_KP_ENTER;
+	case SDL_SCANCODE_KP_1:            return KB_KP_1;
+	case SDL_SCANCODE_KP_2:            return KB_KP_2;
+	case SDL_SCANCODE_KP_3:            return KB_KP_3;
+	case SDL_SCANCODE_KP_4:            return KB_KP_4;
+	case SDL_SCANCODE_KP_5:            return KB_KP_5;
+	case SDL_SCANCODE_KP_6:            return KB_KP_6;
+	case SDL_SCANCODE_KP_7:            return KB_KP_7;
+	case SDL_SCANCODE_KP_8:            return KB_KP_8;
+	case SDL_SCANCODE_KP_9:            return KB_KP_9;
+	case SDL_SCANCODE_KP_0:            return KB_KP_0;
+	case SDL_SCANCODE_KP_PERIOD:       return KB_KP_PERIOD;
+	case SDL_SCANCODE_KP_EQUALS:       return KB_KP_EQUALS;
+	case SDL_SCANCODE_F13:             return KB_F13;
+	case SDL_SCANCODE_F14:             return KB_F14;
+	case SDL_SCANCODE_F15:             return KB_F15;
+	case SDL_SCANCODE_F16:             return KB_F16;
+	case SDL_SCANCODE_F17:             return KB_F17;
+	case SDL_SCANCODE_F18:             return KB_F18;
+	case SDL_SCANCODE_F19:             return KB_F19;
+	case SDL_SCANCODE_F20:             return KB_F20;
+	case SDL_SCANCODE_F21:             return KB_F21;
+	case SDL_SCANCODE_F22:             return KB_F22;
+	case SDL_SCANCODE_F23:             return KB_F23;
+	case SDL_SCANCODE_F24:             return KB_F24;
+	case SDL_SCANCODE_LCTRL:           return KB_LCTRL;
+	case SDL_SCANCODE_LSHIFT:          return KB_LSHIFT;
+	case SDL_SCANCODE_LALT:            return KB_LALT;
+	case SDL_SCANCODE_RCTRL:           return KB_RCTRL;
+	case SDL_SCANCODE_RSHIFT:          return KB_RSHIFT;
+	case SDL_SCANCODE_RALT:            return KB_RALT;
+	default:                           return KB_COUNT;
+	}
+}
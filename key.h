@@ -1,2 +1,3 @@
 b32         is_key(u32 idx);
 const char *key_to_string(gui_key_t key);
+gui_key_t   key_from_scancode(u32 scancode);
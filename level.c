@@ -1,30 +1,74 @@
 #include "config.h"
-#include "violet/all.h"
+#include "core.h"
 #include "action.h"
 #include "types.h"
 #include "actor.h"
+#include "map.h"
 #include "player.h"
+#include "history.h"
 #include "level.h"
 
 void level_init(struct level *level, struct player players[], const struct map *map)
+{
+	for (u32 i = 0; i < PLAYER_CNT_MAX; ++i)
+		history_clear(&players[i].history);
+	level_restart(level, players, map);
+}
+
+/*
+ * The clones are kept struct-of-arrays: clone i is clone_pos[i],
+ * clone_owner[i], ... for every i below num_clones.  The pool is filled
+ * once per restart and clones never leave it; picking one up only sets its
+ * owner, so the actors carry no clone arrays and a level can hold as many
+ * clones as it has tiles.  Loops over the clones are single passes over
+ * the pool, filtering on the owner.
+ */
+
+static
+void level__clones_reserve(struct level *level, u32 n)
+{
+	if (n <= level->clones_cap)
+		return;
+	level->clones_cap = max(level->clones_cap * 2, max(n, 16));
+	level->clone_pos = realloc(level->clone_pos, level->clones_cap * sizeof(v2i));
+	level->clone_owner = realloc(level->clone_owner, level->clones_cap * sizeof(u32));
+	level->clone_order = realloc(level->clone_order, level->clones_cap * sizeof(u32));
+	level->clone_required = realloc(level->clone_required, level->clones_cap * sizeof(u8));
+	level->clone_stack = realloc(level->clone_stack, level->clones_cap * sizeof(u32));
+}
+
+/* Like level_init, but the players' histories are kept */
+void level_restart(struct level *level, struct player players[], const struct map *map)
 {
 	struct actor *actor;
 	u32 player_idx;
 	struct player *player;
 
 	for (u32 i = 0; i < PLAYER_CNT_MAX; ++i)
-		player_init(&players[i], i);
+		player_reset(&players[i]);
 
-	level->map = *map;
+	map_copy(&level->map, map);
 	level->num_actors = 0;
 	level->num_clones = 0;
+	level->num_free_clones = 0;
+	level__clones_reserve(level, 1); /* never NULL, even without clones */
+	free(level->occupancy);
+	level->occupancy = calloc(max(map->dim.x * map->dim.y, 1), sizeof(struct occupant));
+	level->occupancy_stamp = 0;
 	for (s32 i = 0; i < map->dim.y; ++i) {
 		for (s32 j = 0; j < map->dim.x; ++j) {
-			level->map.tiles[i][j].t = 0.f;
+			struct tile *tile;
+			const enum tile_type type = map_tile_type(map, i, j);
+			u32 clone;
+
+			if (type == TILE_BLANK)
+				continue;
+
+			/* only tiles written below stop sharing the map's chunks */
 #ifdef SHOW_TRAVELLED
-			level->map.tiles[i][j].travelled = false;
+			map_tile_mut(&level->map, i, j)->travelled = false;
 #endif
-			switch(map->tiles[i][j].type) {
+			switch(type) {
 			case TILE_BLANK:
 			case TILE_HALL:
 			case TILE_WALL:
@@ -35,30 +79,38 @@ void level_init(struct level *level, struct player players[], const struct map *
 				player_idx = map->actor_controlled_by_player[level->num_actors];
 				player = &players[player_idx];
 
+				tile = map_tile_mut(&level->map, i, j);
+				tile->type = TILE_HALL;
+#ifdef SHOW_TRAVELLED
+				tile->travelled = true;
+#endif
+				/* the actor picks up the clones found so far */
+				level_update_occupancy(level);
 				actor_init(actor, player_idx, j, i, level);
 				++level->num_actors;
 
 				player->actors[player->num_actors] = actor;
 				++player->num_actors;
-
-				level->map.tiles[i][j].type = TILE_HALL;
-#ifdef SHOW_TRAVELLED
-				level->map.tiles[i][j].travelled = true;
-#endif
 			break;
 			case TILE_CLONE:
 			case TILE_CLONE2:
-				level->clones[level->num_clones].pos = (v2i){ .x = j, .y = i };
-				level->clones[level->num_clones].required = map->tiles[i][j].type == TILE_CLONE2;
-				++level->num_clones;
-				level->map.tiles[i][j].type = TILE_HALL;
+				level__clones_reserve(level, level->num_clones + 1);
+				clone = level->num_clones++;
+				++level->num_free_clones;
+				level->clone_pos[clone] = (v2i){ .x = j, .y = i };
+				level->clone_owner[clone] = ACTOR_NONE;
+				level->clone_order[clone] = 0;
+				level->clone_required[clone] = type == TILE_CLONE2;
+				tile = map_tile_mut(&level->map, i, j);
+				tile->type = TILE_HALL;
 #ifdef SHOW_TRAVELLED
-				level->map.tiles[i][j].travelled = true;
+				tile->travelled = true;
 #endif
 			break;
 			}
 		}
 	}
+	level_update_occupancy(level);
 	for (u32 i = 0; i < level->num_actors; ++i) {
 		u32 num_clones_attached;
 		actor_entered_tile(&level->actors[i], level, &num_clones_attached);
@@ -70,12 +122,99 @@ b32 level_complete(const struct level *level)
 {
 	for (u32 i = 0; i < level->num_actors; ++i) {
 		const struct actor *actor = &level->actors[i];
-		if (   level->map.tiles[actor->tile.y][actor->tile.x].type != TILE_DOOR
+		if (   map_tile_type(&level->map, actor->tile.y, actor->tile.x) != TILE_DOOR
 		    || actor->dir != DIR_NONE)
 			return false;
 	}
-	for (u32 i = 0; i < level->num_clones; ++i)
-		if (level->clones[i].required)
+	for (u32 i = 0; i < level->num_clones && level->num_free_clones > 0; ++i)
+		if (level->clone_owner[i] == ACTOR_NONE && level->clone_required[i])
 			return false;
 	return true;
 }
+
+void level_destroy(struct level *level)
+{
+	map_destroy(&level->map);
+	free(level->occupancy);
+	level->occupancy = NULL;
+	free(level->clone_pos);
+	free(level->clone_owner);
+	free(level->clone_order);
+	free(level->clone_required);
+	free(level->clone_stack);
+	level->clone_pos = NULL;
+	level->clone_owner = NULL;
+	level->clone_order = NULL;
+	level->clone_required = NULL;
+	level->clone_stack = NULL;
+	level->num_clones = 0;
+	level->num_free_clones = 0;
+	level->clones_cap = 0;
+}
+
+static
+void level__occupy(struct level *level, v2i tile, u32 player, u32 clone)
+{
+	struct occupant *occupant;
+	if (   tile.x < 0 || tile.x >= level->map.dim.x
+	    || tile.y < 0 || tile.y >= level->map.dim.y)
+		return;
+	occupant = &level->occupancy[tile.y * level->map.dim.x + tile.x];
+	occupant->stamp = level->occupancy_stamp;
+	occupant->player = player;
+	occupant->clone = clone;
+}
+
+/* Re-marks the tiles covered by actors & clones.  Bumping the stamp
+ * invalidates every earlier mark, so nothing needs to be cleared. */
+void level_update_occupancy(struct level *level)
+{
+	if (++level->occupancy_stamp == 0) {
+		memset(level->occupancy, 0, level->map.dim.x * level->map.dim.y
+		                            * sizeof(struct occupant));
+		level->occupancy_stamp = 1;
+	}
+	for (u32 i = 0; i < level->num_actors; ++i)
+		level__occupy(level, level->actors[i].tile, level->actors[i].player, CLONE_NONE);
+	for (u32 i = 0; i < level->num_clones; ++i) {
+		const u32 owner = level->clone_owner[i];
+		if (owner == ACTOR_NONE)
+			level__occupy(level, level->clone_pos[i], PLAYER_CNT_MAX, i);
+		else
+			level__occupy(level, v2i_add(level->actors[owner].tile, level->clone_pos[i]),
+			              level->actors[owner].player, i);
+	}
+}
+
+const struct occupant *level_occupant(const struct level *level, v2i tile)
+{
+	const struct occupant *occupant;
+	assert(   tile.x >= 0 && tile.x < level->map.dim.x
+	       && tile.y >= 0 && tile.y < level->map.dim.y);
+	occupant = &level->occupancy[tile.y * level->map.dim.x + tile.x];
+	return occupant->stamp == level->occupancy_stamp ? occupant : NULL;
+}
+
+/* Where clone i is, attached or not */
+v2i level_clone_tile(const struct level *level, u32 clone)
+{
+	const u32 owner = level->clone_owner[clone];
+	return   owner == ACTOR_NONE
+	       ? level->clone_pos[clone]
+	       : v2i_add(level->actors[owner].tile, level->clone_pos[clone]);
+}
+
+/* The free clone on the tile, or CLONE_NONE */
+u32 level_free_clone(const struct level *level, v2i tile)
+{
+	const struct occupant *occupant;
+	if (   tile.x < 0 || tile.x >= level->map.dim.x
+	    || tile.y < 0 || tile.y >= level->map.dim.y)
+		return CLONE_NONE;
+	occupant = level_occupant(level, tile);
+	if (   !occupant
+	    || occupant->clone == CLONE_NONE
+	    || level->clone_owner[occupant->clone] != ACTOR_NONE)
+		return CLONE_NONE;
+	return occupant->clone;
+}
@@ -1,2 +1,8 @@
 void level_init(struct level *level, struct player players[], const struct map *map);
+void level_restart(struct level *level, struct player players[], const struct map *map);
+void level_destroy(struct level *level);
 b32  level_complete(const struct level *level);
+void level_update_occupancy(struct level *level);
+const struct occupant *level_occupant(const struct level *level, v2i tile);
+v2i  level_clone_tile(const struct level *level, u32 clone);
+u32  level_free_clone(const struct level *level, v2i tile);
@@ -2,6 +2,7 @@
 #ifdef __EMSCRIPTEN__
 #include <emscripten.h>
 #endif
+#include <SDL.h>
 #include "config.h"
 #define VIOLET_IMPLEMENTATION
 #define GUI_FONT_FILE_PATH "data/fonts/Roboto.ttf"
@@ -10,52 +11,26 @@
 #include "audio.h"
 #include "action.h"
 #include "types.h"
+#include "render_types.h"
 #include "constants.h"
+#include "theme.h"
 #include "history.h"
 #include "settings.h"
 #include "disk.h"
 #include "actor.h"
 #include "player.h"
+#include "profile.h"
 #include "level.h"
+#include "map.h"
+#include "particle.h"
+#include "floor.h"
+#include "sim.h"
+#include "sprite.h"
+#include "task.h"
 #include "editor.h"
 
 static const color_t text_color = { .r=0x22, .g=0x1f, .b=0x1f, .a=0xff };
 
-/* TODO: find a better way to to do play/fx globals */
-struct
-{
-	const u32 *level_idx;
-	array(struct map) *maps;
-	const v2i *offset;
-	struct sound *sound_error, *sound_slide, *sound_swipe, *sound_success;
-	array(struct effect) *dissolve_effects;
-	struct player *players;
-	const u32 *num_players;
-} glob;
-
-static
-v2i perp(v2i v, enum action action)
-{
-	switch (action) {
-	case ACTION_ROTATE_CCW:
-		return v2i_lperp(v);
-	break;
-	case ACTION_ROTATE_CW:
-		return v2i_rperp(v);
-	break;
-	case ACTION_MOVE_UP:
-	case ACTION_MOVE_DOWN:
-	case ACTION_MOVE_LEFT:
-	case ACTION_MOVE_RIGHT:
-	case ACTION_UNDO:
-	case ACTION_RESET:
-	case ACTION_COUNT:
-	break;
-	}
-	assert(false);
-	return v;
-}
-
 static
 color_t color_lerp(color_t a, color_t b, r32 t)
 {
@@ -68,104 +43,18 @@ color_t color_lerp(color_t a, color_t b, r32 t)
 }
 
 static
-b32 can_execute_solo_action(enum action action, struct player *player,
-                            const struct level *level)
-{
-	if (action == ACTION_UNDO) {
-		b32 success = true;
-		struct history history_temp;
-		enum action a;
-		u32 num_clones;
-
-		history_clear(&history_temp);
-		for (u32 i = 0; i < player->num_actors; ++i) {
-			const struct actor *actor = player->actors[player->num_actors - i - 1];
-			if (!history_pop(&player->history, &a, &num_clones)) {
-				success = false;
-			} else {
-				success &= actor_can_undo(actor, level, a, num_clones);
-				history_push(&history_temp, a, num_clones);
-			}
-		}
-		while (history_pop(&history_temp, &a, &num_clones))
-			history_push(&player->history, a, num_clones);
-		return success;
-	} else {
-		for (u32 j = 0; j < player->num_actors; ++j)
-			if (!actor_can_act(player->actors[j], level, action))
-				return false;
-	}
-	return true;
-}
-
-static
-void dissolve_effect_add(array(struct effect) *effects, v2i offset, v2i tile,
+void dissolve_effect_add(struct particles *fx, v2i offset, v2i tile,
                          color_t fill, u32 duration)
 {
 #ifdef SHOW_EFFECTS
-	static const v2i half_time = { .x = TILE_SIZE / 2, .y = TILE_SIZE / 2 };
-	const struct effect fx = {
-		.pos = v2i_add(v2i_add(offset, v2i_scale(tile, TILE_SIZE)), half_time),
-		.color = fill,
-		.t = 0.f,
-		.duration = duration,
+	const v2f pos = {
+		.x = offset.x + tile.x * TILE_SIZE + TILE_SIZE / 2,
+		.y = offset.y + tile.y * TILE_SIZE + TILE_SIZE / 2,
 	};
-	array_append(*effects, fx);
+	particles_add(fx, pos, fill, 0.f, duration, 0.f, 0.f);
 #endif
 }
 
-static
-void undo(struct player *player, struct level *level)
-{
-	for (u32 i = 0; i < player->num_actors; ++i) {
-		struct actor *actor = player->actors[player->num_actors - i - 1];
-		enum action action;
-		u32 num_clones;
-		if (history_pop(&player->history, &action, &num_clones)) {
-			for (u32 j = 0; j < num_clones; ++j) {
-				const b32 required = actor->clones[actor->num_clones-1].required;
-				const v2i tile_relative = actor->clones[actor->num_clones-1].pos;
-				const v2i tile_absolute = v2i_add(actor->tile, tile_relative);
-				level->clones[level->num_clones].pos = tile_absolute;
-				level->clones[level->num_clones].required = required;
-				--actor->num_clones;
-				++level->num_clones;
-			}
-			switch (action) {
-			case ACTION_MOVE_UP:
-				--actor->tile.y;
-				actor->pos.y = actor->tile.y * TILE_SIZE;
-			break;
-			case ACTION_MOVE_DOWN:
-				++actor->tile.y;
-				actor->pos.y = actor->tile.y * TILE_SIZE;
-			break;
-			case ACTION_MOVE_LEFT:
-				++actor->tile.x;
-				actor->pos.x = actor->tile.x * TILE_SIZE;
-			break;
-			case ACTION_MOVE_RIGHT:
-				--actor->tile.x;
-				actor->pos.x = actor->tile.x * TILE_SIZE;
-			break;
-			case ACTION_ROTATE_CW:
-				for (u32 j = 0; j < actor->num_clones; ++j)
-					actor->clones[j].pos = v2i_lperp(actor->clones[j].pos);
-			break;
-			case ACTION_ROTATE_CCW:
-				for (u32 j = 0; j < actor->num_clones; ++j)
-					actor->clones[j].pos = v2i_rperp(actor->clones[j].pos);
-			break;
-			case ACTION_UNDO:
-			case ACTION_RESET:
-			case ACTION_COUNT:
-				assert(false);
-			break;
-			}
-		}
-	}
-}
-
 static
 const char *dir_to_string(enum dir dir)
 {
@@ -185,234 +74,99 @@ const char *dir_to_string(enum dir dir)
 	return "none";
 }
 
-static
-void execute_action(enum action action, struct player *player, struct level *level)
-{
-	enum dir dir;
-	struct actor *actor;
-	u32 num_clones_attached;
-
-	switch (action) {
-	case ACTION_MOVE_UP:
-	case ACTION_MOVE_DOWN:
-	case ACTION_MOVE_LEFT:
-	case ACTION_MOVE_RIGHT:
-		dir = g_action_dir[action];
-		for (u32 i = 0; i < player->num_actors; ++i) {
-			actor = player->actors[i];
-			actor->facing = dir;
-			actor->dir = dir;
-			v2i_add_eq(&actor->tile, g_dir_vec[dir]);
-		}
-		sound_play(glob.sound_slide);
-	break;
-	case ACTION_ROTATE_CCW:
-	case ACTION_ROTATE_CW:
-		for (u32 i = 0; i < player->num_actors; ++i) {
-			actor = player->actors[i];
-			for (u32 j = 0; j < actor->num_clones; ++j)
-				actor->clones[j].pos = perp(actor->clones[j].pos, action);
-			actor_entered_tile(actor, level, &num_clones_attached);
-			history_push(&player->history, action, num_clones_attached);
-		}
-		sound_play(glob.sound_swipe);
-	break;
-	case ACTION_UNDO:
-		undo(player, level);
-		for (u32 i = 0; i < *glob.num_players; ++i) {
-			for (u32 j = 0; j < glob.players[i].num_actors; ++j) {
-				u32 num_clones_attached;
-				actor_entered_tile(glob.players[i].actors[j], level, &num_clones_attached);
-				if (num_clones_attached) {
-					enum action a;
-					u32 num_clones;
-					assert(history_pop(&glob.players[i].history, &a, &num_clones));
-					history_push(&glob.players[i].history, a, num_clones_attached + num_clones);
-				}
-			}
-		}
-	break;
-	case ACTION_RESET:
-		history_clear(&player->history);
-		/*if (key_mod(gui, KBM_CTRL)) {
-			const struct map current_map = (*glob.maps)[*glob.level_idx];
-			if (!load_maps(g_current_maps_file_name, glob.maps)) {
-				array_append(*glob.maps, current_map);
-				*glob.level_idx = 0;
-			}
-		}*/
-		level_init(level, glob.players, &(*glob.maps)[*glob.level_idx]);
-	break;
-	case ACTION_COUNT:
-		assert(false);
-	}
-}
-
 #define ANIM_FRAMES 4
 
 struct {
 	struct {
-		img_t *frames[ANIM_FRAMES];
+		const struct sprite *frames[ANIM_FRAMES];
 	} facing[4];
 } anims[3];
 
 static
-void render_figure(gui_t *gui, v2i pos, enum dir dir, u32 stage, u32 anim_milli)
+void render_figure(struct sprite_batch *batch, v2i pos, enum dir dir, u32 stage,
+                   u32 anim_milli)
 {
 	const u32 total_anim_milli = 1000 * (2 * TILE_SIZE) / WALK_SPEED;
 	const u32 anim_frame = (anim_milli / (total_anim_milli / ANIM_FRAMES)) % ANIM_FRAMES;
-	const img_t *img = anims[stage].facing[dir-1].frames[anim_frame];
-	const r32 s = TILE_SIZE / (r32)img->texture.width;
-	gui_img_ex(gui, pos.x, pos.y + TILE_SIZE / 4, img, s, s, 1.f);
+	const struct sprite *sprite = anims[stage].facing[dir-1].frames[anim_frame];
+	const r32 s = TILE_SIZE / (r32)sprite->dim.x;
+	const color_t tint =   stage == 0 ? g_white
+	                     : stage == 1 ? g_tile_fills[TILE_CLONE]
+	                     :              g_tile_fills[TILE_CLONE2];
+	sprite_batch_add(batch, (v2i){ .x = pos.x, .y = pos.y + TILE_SIZE / 4 }, sprite, s, tint);
 }
 
 static
-void render_actor(gui_t *gui, v2i pos, enum dir dir, u32 anim_milli)
+void render_actor(struct sprite_batch *batch, v2i pos, enum dir dir, u32 anim_milli)
 {
-	render_figure(gui, pos, dir, 0, anim_milli);
+	render_figure(batch, pos, dir, 0, anim_milli);
 }
 
 static
-void render_clone(gui_t *gui, v2i pos, b32 required, enum dir dir, u32 anim_milli)
+void render_clone(struct sprite_batch *batch, v2i pos, b32 required, enum dir dir,
+                  u32 anim_milli)
 {
-	render_figure(gui, pos, dir, 1 + required, anim_milli);
+	render_figure(batch, pos, dir, 1 + required, anim_milli);
 }
 
 static
-void door_effect_add(array(struct effect2) *door_effects, s32 x, s32 y)
+void door_effect_add(struct particles *fx, s32 x, s32 y)
 {
 #ifdef ASDF // SHOW_EFFECTS
-	const struct effect2 fx = {
-		.pos = { .x = x + rand() % TILE_SIZE, .y = y + rand() % TILE_SIZE },
-		.color = g_tile_fills[TILE_DOOR],
-		.t = 0.f,
-		.duration = 1000 + rand() % 500,
-		.rotation_start = rand() % 12, /* approximate 2 * PI */
-		.rotation_rate = (rand() % 20) / 3.f - 3.f,
-	};
-	array_append(*door_effects, fx);
+	const v2f pos = { .x = x + rand() % TILE_SIZE, .y = y + rand() % TILE_SIZE };
+	particles_add(fx, pos, g_tile_fills[TILE_DOOR], 0.f, 1000 + rand() % 500,
+	              rand() % 12, /* approximate 2 * PI */
+	              (rand() % 20) / 3.f - 3.f);
 #endif
 }
 
 static
-void background_generate(array(struct effect) *effects, v2i screen)
+void background_generate(struct particles *fx, v2i screen)
 {
 #ifdef SHOW_EFFECTS
-	array_clear(*effects);
+	particles_clear(fx);
 
 	for (u32 i = 0; i < 3; ++i) {
 		for (u32 j = 0; j < 3; ++j) {
-			const struct effect fx = {
-				.pos = {
-					.x = j * screen.x / 3 + rand() % screen.x / 3,
-					.y = i * screen.y / 3 + rand() % screen.y / 3
-				},
-				.color = g_tile_fills[rand() % 5 + 1],
-				.t = (rand() % 100) / 100.f,
-				.duration = 2000 + rand() % 1000,
+			const v2f pos = {
+				.x = j * screen.x / 3 + rand() % screen.x / 3,
+				.y = i * screen.y / 3 + rand() % screen.y / 3
 			};
-			array_append(*effects, fx);
+			particles_add(fx, pos, g_tile_fills[rand() % 5 + 1],
+			              (rand() % 100) / 100.f, 2000 + rand() % 1000, 0.f, 0.f);
 		}
 	}
 #endif
 }
 
+/* Pixel position of the actor, interpolated between the last two ticks */
 static
-void move_actors(struct level *level, struct player players[],
-                 u32 frame_milli, u32 milli_consumed[])
+v2i actor_draw_pos(const struct actor *actor, u32 lag_milli)
 {
-	for (u32 i = 0; i < level->num_actors; ++i) {
-		struct actor *actor = &level->actors[i];
-		r32 pos;
-		s32 dst;
-		const u32 walk_milli = frame_milli - milli_consumed[i];
-
-		switch (actor->dir) {
-		case DIR_NONE:
-		break;
-		case DIR_UP:
-			dst = actor->tile.y * TILE_SIZE;
-			pos = actor->pos.y + WALK_SPEED * walk_milli / 1000.f;
-			if ((s32)pos >= dst) {
-				u32 num_clones_attached;
-				struct player *player = &players[level->map.actor_controlled_by_player[i]];
-				actor_entered_tile(actor, level, &num_clones_attached);
-				history_push(&player->history, ACTION_MOVE_UP, num_clones_attached);
-				milli_consumed[i] = frame_milli -   1000.f * ((s32)pos - dst)
-				                                  / WALK_SPEED;
-				actor->pos.y = dst;
-				actor->dir = DIR_NONE;
-			} else {
-				milli_consumed[i] = frame_milli;
-				actor->pos.y = pos;
-				actor->anim_milli += walk_milli;
-			}
-		break;
-		case DIR_DOWN:
-			dst = actor->tile.y * TILE_SIZE;
-			pos = actor->pos.y - WALK_SPEED * walk_milli / 1000.f;
-			if ((s32)pos <= dst) {
-				struct player *player = &players[level->map.actor_controlled_by_player[i]];
-				u32 num_clones_attached;
-				actor_entered_tile(actor, level, &num_clones_attached);
-				history_push(&player->history, ACTION_MOVE_DOWN, num_clones_attached);
-				milli_consumed[i] = frame_milli -   1000.f * (dst - (s32)pos)
-				                                  / WALK_SPEED;
-				actor->pos.y = dst;
-				actor->dir = DIR_NONE;
-			} else {
-				milli_consumed[i] = frame_milli;
-				actor->pos.y = pos;
-				actor->anim_milli += walk_milli;
-			}
-		break;
-		case DIR_LEFT:
-			dst = actor->tile.x * TILE_SIZE;
-			pos = actor->pos.x - WALK_SPEED * walk_milli / 1000.f;
-			if ((s32)pos <= dst) {
-				struct player *player = &players[level->map.actor_controlled_by_player[i]];
-				u32 num_clones_attached;
-				actor_entered_tile(actor, level, &num_clones_attached);
-				history_push(&player->history, ACTION_MOVE_LEFT, num_clones_attached);
-				milli_consumed[i] = frame_milli -   1000.f * (dst - (s32)pos)
-				                                  / WALK_SPEED;
-				actor->pos.x = dst;
-				actor->dir = DIR_NONE;
-			} else {
-				milli_consumed[i] = frame_milli;
-				actor->pos.x = pos;
-				actor->anim_milli += walk_milli;
-			}
-		break;
-		case DIR_RIGHT:
-			dst = actor->tile.x * TILE_SIZE;
-			pos = actor->pos.x + WALK_SPEED * walk_milli / 1000.f;
-			if ((s32)pos >= dst) {
-				struct player *player = &players[level->map.actor_controlled_by_player[i]];
-				u32 num_clones_attached;
-				actor_entered_tile(actor, level, &num_clones_attached);
-				history_push(&player->history, ACTION_MOVE_RIGHT, num_clones_attached);
-				milli_consumed[i] = frame_milli -   1000.f * ((s32)pos - dst)
-				                                  / WALK_SPEED;
-				actor->pos.x = dst;
-				actor->dir = DIR_NONE;
-			} else {
-				milli_consumed[i] = frame_milli;
-				actor->pos.x = pos;
-				actor->anim_milli += walk_milli;
-			}
-		break;
-		}
-	}
+	const v2i prev = v2i_scale(actor->prev_pos, SIM_TICK_MILLI);
+	const v2i delta = v2i_scale(v2i_sub(actor->pos, actor->prev_pos), lag_milli);
+	return v2i_scale_inv(v2i_scale(v2i_add(prev, delta), TILE_SIZE),
+	                     SUBTILE_DIM * SIM_TICK_MILLI);
 }
 
+/* Center of the actors, in pixels from the map origin */
 static
-b32 all_other_players_pending_action(struct player players[], u32 num_players, u32 excluded_player, enum action action)
+v2i camera_focus(const struct level *level, u32 lag_milli)
 {
-	for (u32 i = 0; i < num_players; ++i)
-		if (i != excluded_player && players[i].pending_action != action)
-			return false;
-	return true;
+	v2i focus = g_v2i_zero;
+	if (level->num_actors == 0)
+		return g_v2i_zero;
+	for (u32 i = 0; i < level->num_actors; ++i)
+		v2i_add_eq(&focus, actor_draw_pos(&level->actors[i], lag_milli));
+	focus = v2i_scale_inv(focus, level->num_actors);
+	return v2i_add(focus, (v2i){ .x = TILE_SIZE / 2, .y = TILE_SIZE / 2 });
+}
+
+static
+b32 on_screen(v2i pos, v2i screen)
+{
+	return    pos.x > -TILE_SIZE && pos.x < screen.x
+	       && pos.y > -TILE_SIZE && pos.y < screen.y;
 }
 
 enum mode {
@@ -425,50 +179,403 @@ gui_t *gui;
 gui_panel_t settings_panel;
 enum mode mode = MENU;
 b32 quit = false;
+b32 woke = false; /* the last frame was followed by an idle wait */
 u32 level_idx = 0;
 struct level level;
+struct sim sim;
+u32 sim_lag_milli;
+array(struct replay_run) session;
 struct player players[PLAYER_CNT_MAX];
 u32 num_players;
+/* Key events seen by input_watch, waiting for the main thread */
+struct key_event {
+	gui_key_t key;
+	b32 down;
+	u32 time;
+};
+array(struct key_event) key_events;
+SDL_mutex *key_events_mutex;
 u32 time_until_next_door_fx = 0;
-struct music music;
+struct music music, music_pack;
 struct sound sound_error, sound_slide, sound_swipe, sound_success;
 /*struct {
 	struct {
 		img_t *frames[4];
 	} facing[4];
 } anims[2];*/
-img_t imgs[3*4*3];
+struct sprite sprites[4*3], sprites_gray[4*3];
+struct sprite_image sprite_images[4*3];
+struct sprite_atlas sprite_atlas;
+struct sprite_batch sprite_batch;
 array(struct map) maps;
-array(struct effect) bg_effects;
-array(struct effect) dissolve_effects;
-array(struct effect2) door_effects;
+struct map_pack pack;
+struct particles bg_fx;
+struct particles dissolve_fx;
+struct particles door_fx;
+array(struct glow) lit_tiles;
+u32 *lit_index; /* per level tile, its glow's index in lit_tiles + 1 */
+struct floor_cache floor_cache;
 v2i screen, offset;
 v2i cursor;
 const char *g_solo_maps_file_name = "data/maps/maps.vson";
+const char *g_replay_file_name = NULL; /* set by --record */
+const char *g_asset_archive_file_name = "data.pak";
 const char *g_coop_maps_file_name = "data/maps/maps_coop.vson";
+#ifdef PROFILE
+const char *g_trace_file_name = "trace.json";
+b32 g_show_profile = false;
+#endif
 char g_current_maps_file_name[128];
 
 
+/* Assets decode on the task pool while the menu is already showing, and
+ * must not be touched until assets_finish() has run. */
+struct asset_load {
+	b32 (*load)(void *asset, const char *file);
+	void *asset;
+	char file[64];
+	b32 loaded;
+	u32 milli;
+};
+struct asset_load asset_loads[4 + 1 + countof(sprite_images)];
+u32 num_asset_loads = 0;
+b32 assets_ready = false;
+
+struct {
+	timepoint_t start;
+	b32 first_frame_done;
+} startup;
+
+
 void frame(void);
 void menu(u32 frame_milli);
 void play(u32 frame_milli);
 
+/* Nothing on screen would change until the next input event */
+static
+b32 frame_quiescent(void)
+{
+	if (time_diff_milli(gui_last_input_time(gui), time_current()) <= IDLE_TIMER_MILLI)
+		return false;
+	if (mode != PLAY)
+		return true;
+	for (u32 i = 0; i < level.num_actors; ++i)
+		if (level.actors[i].dir != DIR_NONE)
+			return false;
+	for (u32 i = 0; i < num_players; ++i)
+		if (players[i].actions_held)
+			return false;
+	/* the background keeps pulsing, but is left frozen once idle */
+	return    array_empty(lit_tiles)
+	       && dissolve_fx.cnt == 0
+	       && door_fx.cnt == 0;
+}
+
+/* Called for every event as SDL receives it, ahead of the gui's polling.
+ * SDL runs it on whichever thread pushed the event, so it only records
+ * the key for input_dispatch. */
+static
+int input_watch(void *userdata, SDL_Event *event)
+{
+	struct key_event key_event;
+
+	if (event->type != SDL_KEYDOWN && event->type != SDL_KEYUP)
+		return 1;
+	if (event->key.repeat)
+		return 1;
+
+	key_event.key = key_from_scancode(event->key.keysym.scancode);
+	key_event.down = event->type == SDL_KEYDOWN;
+	key_event.time = event->key.timestamp;
+	SDL_LockMutex(key_events_mutex);
+	array_append(key_events, key_event);
+	SDL_UnlockMutex(key_events_mutex);
+	return 1;
+}
+
+/* Hands the watched keys to the players.  Presses only count while
+ * playing, not typed into the menu, editor or settings; releases always
+ * do, so no key is left held. */
+static
+void input_dispatch(void)
+{
+	const b32 playing = mode == PLAY && settings_panel.hidden;
+
+	SDL_LockMutex(key_events_mutex);
+	array_foreach(key_events, const struct key_event, key_event) {
+		for (u32 i = 0; i < PLAYER_CNT_LOCAL; ++i) {
+			for (u32 j = 0; j < ACTION_COUNT; ++j) {
+				if (g_key_bindings[i][j] != key_event->key)
+					continue;
+				if (!key_event->down)
+					player_input_release(&players[i], j);
+				else if (playing)
+					player_input_press(&players[i], j, key_event->time);
+			}
+		}
+	}
+	array_clear(key_events);
+	SDL_UnlockMutex(key_events_mutex);
+}
+
+/* Glowing tiles are tracked so they can fade without scanning the map,
+ * and indexed by tile so relighting one doesn't search the others */
+static
+u32 *lit_slot(v2i tile)
+{
+	if (   tile.x < 0 || tile.x >= level.map.dim.x
+	    || tile.y < 0 || tile.y >= level.map.dim.y)
+		return NULL;
+	return &lit_index[tile.y * level.map.dim.x + tile.x];
+}
+
+static
+void light_tile(v2i pos, color_t color)
+{
+	const struct glow glow = { .tile = pos, .color = color, .t = 1.f };
+	u32 *slot = lit_slot(pos);
+	if (!slot) {
+		return;
+	} else if (*slot) {
+		lit_tiles[*slot - 1] = glow;
+	} else {
+		array_append(lit_tiles, glow);
+		*slot = array_sz(lit_tiles);
+	}
+}
+
+/* Once the level's map is in place */
+static
+void lights_reset(void)
+{
+	array_clear(lit_tiles);
+	free(lit_index);
+	lit_index = calloc(max(level.map.dim.x * level.map.dim.y, 1), sizeof(u32));
+}
+
+/* Each level start begins a new run in the session's replay log, when
+ * recording.  Maps not saved to a file can't be replayed, so their runs
+ * are skipped, and only the last REPLAY_RUN_CNT_MAX runs are kept. */
+static
+void replay_run_start(void)
+{
+	struct replay_run run;
+
+	if (!g_replay_file_name || g_current_maps_file_name[0] == '\0')
+		return;
+
+	if (array_sz(session) == REPLAY_RUN_CNT_MAX) {
+		array_destroy(session[0].inputs);
+		array_remove(session, 0);
+	}
+
+	memset(&run, 0, sizeof(run));
+	run.level_idx = level_idx;
+	run.num_players = num_players;
+	run.inputs = array_create();
+	strncpy(run.maps_file_name, g_current_maps_file_name, sizeof(run.maps_file_name) - 1);
+	array_append(session, run);
+	sim.log = &array_last(session).inputs;
+}
+
+/* A pack can have its own score in data/sounds, named after its maps file;
+ * the rest share the main one.  Switching packs crossfades between them. */
+static
+void pack_music_play(const char *maps_file_name)
+{
+	struct music prev = music_pack;
+	const char *name = strrchr(maps_file_name, '/');
+	const char *ext;
+	char file[MUSIC_PATH_MAX];
+
+	name = name ? name + 1 : maps_file_name;
+	ext = strrchr(name, '.');
+	snprintf(file, sizeof(file), "data/sounds/%.*s.%s",
+	         (int)(ext ? (size_t)(ext - name) : strlen(name)), name,
+#ifdef __EMSCRIPTEN__
+	         "mp3");
+#else
+	         "aiff");
+#endif
+	if (music_init(&music_pack, file)) {
+		music_play(&music_pack);
+	} else {
+		music_destroy(&music_pack);
+		music_play(&music);
+	}
+	music_destroy(&prev);
+}
+
+/* Reports what the simulation did, through sound and by restarting the level */
+static
+void sim_events(u32 idx, u32 events)
+{
+	if (events & SIM_EVENT_SLIDE)
+		sound_play(&sound_slide);
+	if (events & SIM_EVENT_SWIPE)
+		sound_play(&sound_swipe);
+	if (events & SIM_EVENT_BLOCKED) {
+		/* don't buzz every tick while a move key is held against a wall */
+		players[idx].action_repeat_timer = ACTION_REPEAT_INTERVAL;
+		sound_play(&sound_error);
+	}
+	if (events & SIM_EVENT_RESET) {
+		level_restart(&level, players, map_pack_get(&pack, level_idx));
+		lights_reset();
+	}
+}
+
+/* Scrubs through a solo attempt, including the moves undone since */
+static
+void timeline(void)
+{
+	const u32 num_moves = sim_num_moves(&sim, 0);
+	const u32 num_moves_max = sim_num_moves_max(&sim, 0);
+	const s32 w = 200, h = 16;
+	const s32 x = (screen.x - w) / 2;
+	const s32 y = 5;
+	char buf[32];
+	r32 val;
+
+	if (num_moves_max == 0)
+		return;
+
+	val = (r32)num_moves / num_moves_max;
+	if (gui_slider_x(gui, x, y, w, h, &val)) {
+		const u32 target = (u32)(val * num_moves_max + 0.5f);
+		if (target != num_moves)
+			sim_seek(&sim, 0, target);
+	}
+	snprintf(buf, sizeof(buf), "%u/%u", num_moves, num_moves_max);
+	gui_txt(gui, x + w / 2, y + h + 4, 14, buf, text_color, GUI_ALIGN_CENTER);
+
+	/* other lines of play tried from this move */
+	if (   history_num_branches(&players[0].history) > 0
+	    && gui_btn_txt(gui, x + w + 5, y, 60, h, "Branch") == BTN_PRESS)
+		sim_branch(&sim, 0);
+}
+
+static
+b32 load_sound(void *sound, const char *file)
+{
+	return sound_init(sound, file);
+}
+
+static
+b32 load_music(void *music, const char *file)
+{
+	return music_init(music, file);
+}
+
+static
+b32 load_sprite(void *image, const char *file)
+{
+	return sprite_image_load(image, file);
+}
+
+static
+void asset_load_run(void *udata)
+{
+	struct asset_load *load = udata;
+	const timepoint_t start = time_current();
+	load->loaded = load->load(load->asset, load->file);
+	load->milli = time_diff_milli(start, time_current());
+}
+
+static
+void asset_load_start(b32 (*load)(void *asset, const char *file), void *asset,
+                      const char *file)
+{
+	struct asset_load *asset_load = &asset_loads[num_asset_loads++];
+	asset_load->load = load;
+	asset_load->asset = asset;
+	snprintf(B2PS(asset_load->file), "%s", file);
+	asset_load->loaded = false;
+	asset_load->milli = 0;
+	task_run(asset_load_run, asset_load);
+}
+
+/* Waits for any decoding still running, then packs the sprite atlas */
+static
+void assets_finish(void)
+{
+	u32 sprite_milli = 0, sound_milli = 0, music_milli = 0;
+	timepoint_t start;
+
+	if (assets_ready)
+		return;
+
+	tasks_wait();
+	for (u32 i = 0; i < num_asset_loads; ++i) {
+		const struct asset_load *load = &asset_loads[i];
+		check(load->loaded);
+		if (load->load == load_sprite)
+			sprite_milli += load->milli;
+		else if (load->load == load_sound)
+			sound_milli += load->milli;
+		else
+			music_milli += load->milli;
+	}
+
+	start = time_current();
+	check(sprite_atlas_init(&sprite_atlas, sprite_images, countof(sprites),
+	                        sprites, sprites_gray));
+	for (u32 i = 0; i < countof(sprite_images); ++i)
+		sprite_image_destroy(&sprite_images[i]);
+
+	music_play(&music);
+	assets_ready = true;
+
+	log_info("startup: assets ready at %u ms (decoding sprites %u ms, sounds %u ms, "
+	         "music %u ms; atlas packing %u ms)",
+	         time_diff_milli(startup.start, time_current()), sprite_milli,
+	         sound_milli, music_milli, time_diff_milli(start, time_current()));
+}
+
+static
+void level_start(u32 idx)
+{
+	level_idx = idx;
+	sim_lag_milli = 0;
+	floor_reset(&floor_cache);
+	level_init(&level, players, map_pack_get(&pack, level_idx));
+	lights_reset();
+	map_pack_prefetch(&pack, level_idx);
+	sim_init(&sim, &level, players, num_players);
+	replay_run_start();
+}
+
 int main(int argc, char *const argv[])
 {
+	u32 window_milli, audio_milli;
+
+	startup.start = time_current();
+
 	log_add_std(LOG_STDOUT);
 
+	for (int i = 1; i < argc; ++i)
+		if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+			g_replay_file_name = argv[++i];
+
 	srand(time(NULL));
 
-	gui = gui_create(0, 0, (MAP_DIM_MAX + 2 * TILE_BORDER_DIM) * TILE_SIZE,
-	                (MAP_DIM_MAX + 2 * TILE_BORDER_DIM) * TILE_SIZE,
+	/* release builds ship their assets packed - loose files are the fallback */
+	if (archive_mount(g_asset_archive_file_name))
+		log_info("assets from %s", g_asset_archive_file_name);
+
+	gui = gui_create(0, 0, (MAP_VIEW_DIM + 2 * TILE_BORDER_DIM) * TILE_SIZE,
+	                (MAP_VIEW_DIM + 2 * TILE_BORDER_DIM) * TILE_SIZE,
 	                APP_NAME, WINDOW_CENTERED);
-	if (!gui)
+	if (!gui) {
+		archive_unmount();
 		return 1;
+	}
+	window_milli = time_diff_milli(startup.start, time_current());
 
 	gui_style(gui)->bg_color = g_sky;
 
 	pgui_panel_init(gui, &settings_panel, TILE_SIZE, 2 * TILE_SIZE,
-	                MAP_DIM_MAX * TILE_SIZE, (MAP_DIM_MAX - 2) * TILE_SIZE,
+	                MAP_VIEW_DIM * TILE_SIZE, (MAP_VIEW_DIM - 2) * TILE_SIZE,
 	                "", GUI_PANEL_CLOSABLE | GUI_PANEL_SCROLLBARS);
 	hide_settings(&settings_panel);
 
@@ -476,146 +583,194 @@ int main(int argc, char *const argv[])
 
 	if (!audio_init())
 		goto err_audio;
+	audio_milli = time_diff_milli(startup.start, time_current()) - window_milli;
+
+	check(tasks_init());
 
 #ifdef __EMSCRIPTEN__
-	check(sound_init(&sound_error, "data/sounds/error.mp3"));
-	check(sound_init(&sound_slide, "data/sounds/slide.mp3"));
-	check(sound_init(&sound_swipe, "data/sounds/swipe.mp3"));
-	check(sound_init(&sound_success, "data/sounds/success.mp3"));
-	check(music_init(&music, "data/sounds/score.mp3"));
+	asset_load_start(load_sound, &sound_error, "data/sounds/error.mp3");
+	asset_load_start(load_sound, &sound_slide, "data/sounds/slide.mp3");
+	asset_load_start(load_sound, &sound_swipe, "data/sounds/swipe.mp3");
+	asset_load_start(load_sound, &sound_success, "data/sounds/success.mp3");
+	asset_load_start(load_music, &music, "data/sounds/score.mp3");
 #else
-	check(sound_init(&sound_error, "data/sounds/error.aiff"));
-	check(sound_init(&sound_slide, "data/sounds/slide.aiff"));
-	check(sound_init(&sound_swipe, "data/sounds/swipe.aiff"));
-	check(sound_init(&sound_success, "data/sounds/success.aiff"));
-	check(music_init(&music, "data/sounds/score.aiff"));
+	asset_load_start(load_sound, &sound_error, "data/sounds/error.aiff");
+	asset_load_start(load_sound, &sound_slide, "data/sounds/slide.aiff");
+	asset_load_start(load_sound, &sound_swipe, "data/sounds/swipe.aiff");
+	asset_load_start(load_sound, &sound_success, "data/sounds/success.aiff");
+	asset_load_start(load_music, &music, "data/sounds/score.aiff");
 #endif
 
-	{
-		static const char *names[] = { "actor", "clone", "clone2" };
-		for (u32 k = 0; k < 3; ++k) {
-			for (u32 i = 0; i < 4; ++i) {
-				const enum dir dir = i + 1;
-				for (u32 j = 0; j < 3; ++j) {
-					char fname[64];
-					snprintf(B2PS(fname), "data/sprites/%s/%s_%u.png", names[k], dir_to_string(dir), j);
-					check(img_load(&imgs[k*12+i*3+j], fname));
-				}
-			}
+	for (u32 i = 0; i < 4; ++i) {
+		const enum dir dir = i + 1;
+		for (u32 j = 0; j < 3; ++j) {
+			char fname[64];
+			snprintf(B2PS(fname), "data/sprites/actor/%s_%u.png", dir_to_string(dir), j);
+			asset_load_start(load_sprite, &sprite_images[i*3+j], fname);
 		}
 	}
+	/* clones are the actor frames in grayscale, tinted when drawn */
 	for (u32 i = 0; i < 3; ++i) {
+		const struct sprite *frames = i == 0 ? sprites : sprites_gray;
 		for (u32 j = 0; j < 4; ++j) {
-			anims[i].facing[j].frames[0] = &imgs[i*12+j*3];
-			anims[i].facing[j].frames[1] = &imgs[i*12+j*3+1];
-			anims[i].facing[j].frames[2] = &imgs[i*12+j*3];
-			anims[i].facing[j].frames[3] = &imgs[i*12+j*3+2];
+			anims[i].facing[j].frames[0] = &frames[j*3];
+			anims[i].facing[j].frames[1] = &frames[j*3+1];
+			anims[i].facing[j].frames[2] = &frames[j*3];
+			anims[i].facing[j].frames[3] = &frames[j*3+2];
 		}
 	}
+	sprite_batch_init(&sprite_batch);
 
 	maps = array_create();
 
 	load_settings();
 
 	for (u32 i = 0; i < PLAYER_CNT_MAX; ++i)
-		player_init(&players[i], i);
+		player_init(&players[i]);
+	key_events = array_create();
+	key_events_mutex = SDL_CreateMutex();
+	check(key_events_mutex);
+	SDL_AddEventWatch(input_watch, NULL);
 
-	bg_effects = array_create();
-	background_generate(&bg_effects, screen);
+	particles_init(&bg_fx, PARTICLE_PULSE, PARTICLE_BG_CNT_MAX);
+	background_generate(&bg_fx, screen);
 
-	dissolve_effects = array_create();
+	particles_init(&dissolve_fx, PARTICLE_DISSOLVE, PARTICLE_DISSOLVE_CNT_MAX);
 
-	door_effects = array_create();
+	particles_init(&door_fx, PARTICLE_SPIN, PARTICLE_DOOR_CNT_MAX);
 
-	glob.level_idx = &level_idx;
-	glob.sound_error = &sound_error;
-	glob.sound_slide = &sound_slide;
-	glob.sound_swipe = &sound_swipe;
-	glob.sound_success = &sound_success;
-	glob.maps = &maps;
-	glob.dissolve_effects = &dissolve_effects;
-	glob.offset = &offset;
-	glob.players = players;
-	glob.num_players = &num_players;
+	lit_tiles = array_create();
 
-	music_play(&music);
+	session = array_create();
+
+	floor_init(&floor_cache);
 
 	editor_init();
 
+	log_info("startup: window %u ms, audio %u ms, setup done at %u ms",
+	         window_milli, audio_milli, time_diff_milli(startup.start, time_current()));
+
 #ifdef __EMSCRIPTEN__
 	emscripten_set_main_loop(frame, 0, 0);
 	return 0;
 #else
 	while (!quit) {
-		u32 frame_milli, fps;
+		u32 frame_milli;
+		if (frame_quiescent()) {
+			profile_begin("wait");
+			SDL_WaitEvent(NULL);
+			profile_end();
+			woke = true;
+		}
 		frame();
 		frame_milli = time_diff_milli(gui_frame_start(gui), time_current());
-#ifdef SHOW_EFFECTS
-		fps =   mode == EDIT && time_diff_milli(gui_last_input_time(gui), time_current())
-			    > IDLE_TIMER_MILLI ? FPS_IDLE : FPS_CAP;
-#else
-		fps =   time_diff_milli(gui_last_input_time(gui), time_current())
-			    > IDLE_TIMER_MILLI ? FPS_IDLE : FPS_CAP;
-#endif
-		if (frame_milli < (u32)(1000.f / fps))
-			time_sleep_milli((u32)(1000.f / fps) - frame_milli);
+		if (frame_milli < (u32)(1000.f / FPS_CAP)) {
+			profile_begin("sleep");
+			time_sleep_milli((u32)(1000.f / FPS_CAP) - frame_milli);
+			profile_end();
+		}
 	}
 #endif
 
-	array_destroy(door_effects);
-	array_destroy(dissolve_effects);
-	array_destroy(bg_effects);
+	flush_settings();
+	tasks_destroy();
+	for (u32 i = 0; i < countof(sprite_images); ++i)
+		sprite_image_destroy(&sprite_images[i]);
+	particles_destroy(&door_fx);
+	particles_destroy(&dissolve_fx);
+	particles_destroy(&bg_fx);
+	array_destroy(lit_tiles);
+	free(lit_index);
+	if (g_replay_file_name && array_sz(session) > 0)
+		save_replay(g_replay_file_name, session);
+	replay_clear(&session);
+	array_destroy(session);
+	floor_destroy(&floor_cache);
+	for (u32 i = 0; i < PLAYER_CNT_MAX; ++i)
+		player_destroy(&players[i]);
+	level_destroy(&level);
+	map_pack_close(&pack);
+	map_array_clear(&maps);
 	array_destroy(maps);
-	for (u32 i = 0; i < countof(imgs); ++i)
-		img_destroy(&imgs[i]);
+	sprite_batch_destroy(&sprite_batch);
+	sprite_atlas_destroy(&sprite_atlas);
+	music_destroy(&music_pack);
+	music_destroy(&music);
+	audio_destroy();
 	sound_destroy(&sound_swipe);
 	sound_destroy(&sound_slide);
 	sound_destroy(&sound_success);
 	sound_destroy(&sound_error);
-	music_destroy(&music);
-	audio_destroy();
+	SDL_DelEventWatch(input_watch, NULL);
+	SDL_DestroyMutex(key_events_mutex);
+	array_destroy(key_events);
 err_audio:
 	gui_destroy(gui);
+	archive_unmount();
 	return 0;
 }
 
 void frame(void)
 {
 	u32 frame_milli;
+	b32 running;
 
-	if (!gui_begin_frame(gui)) {
+	profile_frame_begin();
+
+	profile_begin("input");
+	running = gui_begin_frame(gui);
+	profile_end();
+	if (!running) {
 		quit = true;
 		return;
 	}
+	input_dispatch();
 
 	frame_milli = gui_frame_time_milli(gui);
+	/* nothing was moving while idle, so the simulation owes none of it */
+	if (woke) {
+		frame_milli = min(frame_milli, (u32)(1000.f / FPS_CAP));
+		woke = false;
+	}
 
 	gui_dim(gui, &screen.x, &screen.y);
-	offset = v2i_scale_inv(v2i_sub(screen, v2i_scale(level.map.dim, TILE_SIZE)), 2);
+	offset = map_view_offset(level.map.dim, screen, camera_focus(&level, sim_lag_milli));
 
-	if (!settings_panel.hidden)
+	if (!assets_ready && tasks_pending() == 0)
+		assets_finish();
+
+	if (!settings_panel.hidden) {
+		profile_begin("settings");
 		show_settings(gui, &settings_panel);
+		profile_end();
+	}
 
 	switch (mode) {
 	case MENU:
+		profile_begin("menu");
 		menu(frame_milli);
+		profile_end();
 		quit |= key_pressed(gui, KB_ESCAPE);
 	break;
 	case PLAY:
+		profile_begin("play");
 		play(frame_milli);
+		profile_end();
 		if (key_pressed(gui, KB_ESCAPE))
 			mode = MENU;
 	break;
 	case EDIT:;
 #ifndef __EMSCRIPTEN__
 		u32 level_to_play;
+		profile_begin("editor");
 		editor_update(gui, &level_to_play);
+		profile_end();
 		if (level_to_play < array_sz(maps)) {
 			if (   g_current_maps_file_name[0] != '\0'
 			    || file_save_dialog(g_current_maps_file_name, 128, "vson"))
 				save_maps(g_current_maps_file_name, maps);
-			level_idx = level_to_play;
-			level_init(&level, players, &maps[level_idx]);
+			map_pack_open_maps(&pack, &maps);
+			level_start(level_to_play);
 			mode = PLAY;
 		} else if (key_pressed(gui, KB_ESCAPE)) {
 			mode = MENU;
@@ -624,7 +779,26 @@ void frame(void)
 	break;
 	}
 
+#ifdef PROFILE
+	if (key_pressed(gui, KB_F3) && !is_key_bound(KB_F3))
+		g_show_profile = !g_show_profile;
+	if (key_pressed(gui, KB_F4) && !is_key_bound(KB_F4))
+		profile_export(g_trace_file_name);
+	if (g_show_profile)
+		profile_overlay(gui, 5, screen.y - 30, text_color);
+#endif
+
+	profile_begin("gui_end_frame");
 	gui_end_frame(gui);
+	profile_end();
+
+	profile_frame_end();
+
+	if (!startup.first_frame_done) {
+		startup.first_frame_done = true;
+		log_info("startup: first frame at %u ms",
+		         time_diff_milli(startup.start, time_current()));
+	}
 }
 
 void menu(u32 frame_milli)
@@ -637,32 +811,35 @@ void menu(u32 frame_milli)
 	/* TODO: support tabbing through 'selected' buttons in gui */
 	if (   (   gui_btn_txt(gui, x, y, w, h, "Solo") == BTN_PRESS
 	        || key_pressed(gui, KB_1))
-	    && load_maps(g_solo_maps_file_name, &maps)) {
+	    && map_pack_open(&pack, g_solo_maps_file_name)) {
+		assets_finish();
 		mode = PLAY;
-		level_idx = 0;
 		num_players = 1;
 		strcpy(g_current_maps_file_name, g_solo_maps_file_name);
-		level_init(&level, players, &maps[level_idx]);
-		background_generate(&bg_effects, screen);
+		pack_music_play(g_current_maps_file_name);
+		level_start(0);
+		background_generate(&bg_fx, screen);
 	}
 	y -= h;
 	if (   (   gui_btn_txt(gui, x, y, w, h, "Co-op") == BTN_PRESS
 	        || key_pressed(gui, KB_2))
-	    && load_maps(g_coop_maps_file_name, &maps)) {
+	    && map_pack_open(&pack, g_coop_maps_file_name)) {
+		assets_finish();
 		mode = PLAY;
-		level_idx = 0;
 		num_players = 2;
 		strcpy(g_current_maps_file_name, g_coop_maps_file_name);
-		level_init(&level, players, &maps[level_idx]);
-		background_generate(&bg_effects, screen);
+		pack_music_play(g_current_maps_file_name);
+		level_start(0);
+		background_generate(&bg_fx, screen);
 	}
 	y -= h;
 #ifndef __EMSCRIPTEN__
 	if (gui_btn_txt(gui, x, y, w, h, "Edit") == BTN_PRESS || key_pressed(gui, KB_3)) {
+		assets_finish();
 		mode = EDIT;
 		level_idx = 0;
 		num_players = 1;
-		array_clear(maps);
+		map_array_clear(&maps);
 		g_current_maps_file_name[0] = '\0';
 		if (   file_open_dialog(g_current_maps_file_name, 128, "vson")
 		    && load_maps(g_current_maps_file_name, &maps)) {
@@ -683,29 +860,17 @@ void play(u32 frame_milli)
 {
 #ifdef DEBUG
 	if (key_pressed(gui, KB_G))
-		background_generate(&bg_effects, screen);
+		background_generate(&bg_fx, screen);
 #endif // DEBUG
 
-	array_foreach(bg_effects, struct effect, fx) {
-		fx->t += (r32)frame_milli / fx->duration;
-		if (fx->t > 2.f)
-			fx->t = 0.f;
-		if (fx->t <= 1.f) {
-			const u32 sz = TILE_SIZE;
-			color_t fill = fx->color;
-			fill.a = 48 * fx->t + 16;
-			gui_rect(gui, fx->pos.x - sz / 2, fx->pos.y - sz / 2, sz, sz, fill, g_nocolor);
-		} else if (fx->t <= 2.f) {
-			const u32 sz = TILE_SIZE;
-			color_t fill = fx->color;
-			fill.a = 48 * (2.f - fx->t) + 16;
-			gui_rect(gui, fx->pos.x - sz / 2, fx->pos.y - sz / 2, sz, sz, fill, g_nocolor);
-		}
-	}
+	profile_begin("background");
+	particles_update(&bg_fx, frame_milli);
+	particles_draw(&bg_fx, gui);
+	profile_end();
 
 	{
 		char buf[16];
-		snprintf(buf, 16, "%u/%u", level_idx + 1, array_sz(maps));
+		snprintf(buf, 16, "%u/%u", level_idx + 1, map_pack_sz(&pack));
 		gui_txt(gui, 5, screen.y - 5, 20, buf, text_color, GUI_ALIGN_LEFT | GUI_ALIGN_TOP);
 	}
 
@@ -750,7 +915,7 @@ void play(u32 frame_milli)
 		gui_style_pop(gui);
 	}
 
-	gui_txt(gui, offset.x + level.map.dim.x * TILE_SIZE / 2, offset.y - 20, 14,
+	gui_txt(gui, screen.x / 2, max(offset.y, TILE_BORDER_DIM * TILE_SIZE) - 20, 14,
 	        level.map.tip, text_color, GUI_ALIGN_CENTER);
 
 #if 0
@@ -764,159 +929,88 @@ void play(u32 frame_milli)
 #endif
 
 	if (!level.complete) {
-		for (s32 i = 0; i < level.map.dim.y; ++i) {
+		const s32 o2 = g_tile_inset;
+		v2i first, last;
+
+		profile_begin("floor");
+		floor_draw(&floor_cache, gui, &level.map, offset, screen);
+
+		/* the floor is static apart from the glow of recently visited tiles */
+		array_foreach(lit_tiles, const struct glow, lit) {
+			const v2i pos = v2i_add(offset, v2i_scale(lit->tile, TILE_SIZE));
+			const color_t c = color_lerp(lit->color, g_stone, lit->t);
+			const s32 x = pos.x, y = pos.y;
+			if (!on_screen(pos, screen))
+				continue;
+			gui_rect(gui, x+o2, y+o2, TILE_SIZE-2*o2, TILE_SIZE-2*o2, c, g_nocolor);
+			gui_line(gui, x+o2, y+o2, x+TILE_SIZE-o2, y+o2, 3, g_stone_dark);
+			gui_line(gui, x+o2, y+o2, x+o2, y+TILE_SIZE-o2, 1, g_stone_dark);
+		}
+		profile_end();
+
+		profile_begin("tiles");
+		map_view_bounds(level.map.dim, screen, offset, &first, &last);
+		for (s32 i = first.y; i < last.y; ++i) {
 			const s32 y = offset.y + i * TILE_SIZE;
-			for (s32 j = 0; j < level.map.dim.x; ++j) {
+			for (s32 j = first.x; j < last.x; ++j) {
 				const s32 x = offset.x + j * TILE_SIZE;
-				const enum tile_type type = level.map.tiles[i][j].type;
-				const s32 o2 = TILE_SIZE / 10;
-				const s32 s2 = TILE_SIZE - 2 * o2;
-				const s32 h3 = TILE_SIZE / 5;
-				color_t c;
-				switch (type) {
-				case TILE_BLANK:
-				case TILE_ACTOR:
-				case TILE_CLONE:
-				case TILE_CLONE2:
-				break;
-				case TILE_HALL:;
-					c = color_lerp(level.map.tiles[i][j].active_color, g_stone,
-					               level.map.tiles[i][j].t);
-					gui_rect(gui, x, y, TILE_SIZE, TILE_SIZE, g_grass, g_nocolor);
-					gui_rect(gui, x+o2, y+o2, s2, s2, c, g_nocolor);
-					gui_line(gui, x+o2, y+o2, x+TILE_SIZE-o2, y+o2, 3, g_stone_dark);
-					gui_line(gui, x+o2, y+o2, x+o2, y+TILE_SIZE-o2, 1, g_stone_dark);
-					if (i == 0 || level.map.tiles[i-1][j].type == TILE_WALL)
-						gui_rect(gui, x, y-h3, TILE_SIZE, h3, g_grass_dark, g_nocolor);
-				break;
-				case TILE_WALL:
-				break;
-				case TILE_DOOR:
-					c = color_lerp(level.map.tiles[i][j].active_color, g_stone,
-					               level.map.tiles[i][j].t);
-					gui_rect(gui, x, y, TILE_SIZE, TILE_SIZE, g_door, g_nocolor);
-					gui_rect(gui, x+o2, y+o2, s2, s2, c, g_nocolor);
-					gui_line(gui, x+o2, y+o2, x+TILE_SIZE-o2, y+o2, 3, g_stone_dark);
-					gui_line(gui, x+o2, y+o2, x+o2, y+TILE_SIZE-o2, 1, g_stone_dark);
-					if (i == 0 || level.map.tiles[i-1][j].type == TILE_WALL)
-						gui_rect(gui, x, y-h3, TILE_SIZE, h3, g_door_dark, g_nocolor);
-
+				if (map_tile_type(&level.map, i, j) == TILE_DOOR) {
 					if (frame_milli >= time_until_next_door_fx) {
-						door_effect_add(&door_effects, x, y);
+						door_effect_add(&door_fx, x, y);
 						time_until_next_door_fx = 100 + rand() % 100;
 					} else {
 						time_until_next_door_fx -= frame_milli;
 					}
-				break;
 				}
 #ifdef SHOW_TRAVELLED
-				if (level.map.tiles[i][j].travelled)
+				if (map_tile(&level.map, i, j)->travelled)
 					gui_circ(gui, x + TILE_SIZE / 2, y + TILE_SIZE / 2, TILE_SIZE / 8,
 					         g_red, g_nocolor);
 #endif
 			}
 		}
+		profile_end();
 	}
 
-	for (u32 i = 0; i < array_sz(door_effects); ) {
-		struct effect2 *fx = &door_effects[i];
-		const r32 delta = (r32)frame_milli / fx->duration;
-		fx->t += delta;
-		if (fx->t <= 1.f) {
-			const r32 sz = TILE_SIZE / 2 * fx->t;
-			const m3f m = m3f_init_rotation(fx->rotation_start + fx->rotation_rate * fx->t);
-			v2f square[4] = {
-				v2f_add(m3f_mul_v2(m, (v2f){ .x =  sz / 2, .y =  sz / 2 }), fx->pos),
-				v2f_add(m3f_mul_v2(m, (v2f){ .x = -sz / 2, .y =  sz / 2 }), fx->pos),
-				v2f_add(m3f_mul_v2(m, (v2f){ .x = -sz / 2, .y = -sz / 2 }), fx->pos),
-				v2f_add(m3f_mul_v2(m, (v2f){ .x =  sz / 2, .y = -sz / 2 }), fx->pos),
-			};
-			color_t fill = fx->color;
-			fill.a = 48 * fx->t + 48;
-			gui_polyf(gui, square, 4, fill, g_nocolor);
-			++i;
-		} else if (fx->t <= 2.f) {
-			const r32 sz = TILE_SIZE / 2 * (2.f - fx->t);
-			const m3f m = m3f_init_rotation(fx->rotation_start + fx->rotation_rate * fx->t);
-			v2f square[4] = {
-				v2f_add(m3f_mul_v2(m, (v2f){ .x =  sz / 2, .y =  sz / 2 }), fx->pos),
-				v2f_add(m3f_mul_v2(m, (v2f){ .x = -sz / 2, .y =  sz / 2 }), fx->pos),
-				v2f_add(m3f_mul_v2(m, (v2f){ .x = -sz / 2, .y = -sz / 2 }), fx->pos),
-				v2f_add(m3f_mul_v2(m, (v2f){ .x =  sz / 2, .y = -sz / 2 }), fx->pos),
-			};
-			color_t fill = fx->color;
-			fill.a = 48 * (2.f - fx->t) + 48;
-			gui_polyf(gui, square, 4, fill, g_nocolor);
-			++i;
-		} else {
-			array_remove_fast(door_effects, i);
-		}
-	}
-
-	for (u32 i = 0; i < array_sz(dissolve_effects); ) {
-		struct effect *fx = &dissolve_effects[i];
-		fx->t += (r32)frame_milli / fx->duration;
-		if (fx->t <= 1.f) {
-			const u32 sz = (TILE_SIZE - 4) * (1.f - fx->t);
-			color_t fill = fx->color;
-			fill.a = 255 * (1.f - fx->t);
-			gui_rect(gui, fx->pos.x - sz / 2, fx->pos.y - sz / 2, sz, sz, fill, g_nocolor);
-			++i;
-		} else {
-			array_remove_fast(dissolve_effects, i);
-		}
-	}
+	profile_begin("effects");
+	particles_update(&door_fx, frame_milli);
+	particles_update(&dissolve_fx, frame_milli);
+	particles_draw(&door_fx, gui);
+	particles_draw(&dissolve_fx, gui);
+	profile_end();
 
 	if (settings_panel.hidden) {
-		u32 milli_consumed[ACTOR_CNT_MAX] = {0};
-		move_actors(&level, players, frame_milli, milli_consumed);
-
-		for (u32 i = 0; i < num_players; ++i) {
-			struct player *player = &players[i];
-			const enum action action = player_desired_action(player, gui);
-
-			if (action == ACTION_COUNT)
-				continue;
-
-			if (action_is_solo(action)) {
-				if (can_execute_solo_action(action, player, &level)) {
-					execute_action(action, player, &level);
-				} else {
-					switch (action) {
-					case ACTION_MOVE_UP:
-					case ACTION_MOVE_DOWN:
-					case ACTION_MOVE_LEFT:
-					case ACTION_MOVE_RIGHT:
-						for (u32 j = 0; j < player->num_actors; ++j)
-							player->actors[j]->facing = g_action_dir[action];
-					default:
-					break;
-					}
-					sound_play(&sound_error);
-				}
-			} else if (num_players == 1) {
-				execute_action(action, player, &level);
-			} else if (all_other_players_pending_action(players, num_players, i, action)) {
-				execute_action(action, player, &level);
-				for (u32 j = 0; j < num_players; ++j)
-					players[j].pending_action = ACTION_COUNT;
-			} else if (player->pending_action == action) {
-				player->pending_action = ACTION_COUNT;
-			} else {
-				player->pending_action = action;
+		const u32 now = SDL_GetTicks();
+
+		if (gui_any_widget_has_focus(gui))
+			for (u32 i = 0; i < num_players; ++i)
+				player_input_clear(&players[i]);
+
+		/* the simulation runs in fixed ticks regardless of the frame rate,
+		 * dropping time only when a frame takes far too long.  Input is
+		 * checked every tick so that a queued move starts the moment the
+		 * previous one finishes. */
+		profile_begin("sim");
+		sim_lag_milli = min(sim_lag_milli + frame_milli, SIM_LAG_MAX_MILLI);
+		while (sim_lag_milli >= SIM_TICK_MILLI) {
+			sim_tick(&sim);
+			for (u32 i = 0; i < num_players; ++i) {
+				const enum action action = player_next_action(&players[i], now,
+				                                              SIM_TICK_MILLI);
+				if (action != ACTION_COUNT)
+					sim_events(i, sim_act(&sim, i, action));
 			}
+			sim_lag_milli -= SIM_TICK_MILLI;
 		}
-
-		if (!level_complete(&level))
-			move_actors(&level, players, frame_milli, milli_consumed);
+		profile_end();
 
 		for (u32 i = 0; i < level.num_actors; ++i)
 			if (level.actors[i].dir == DIR_NONE)
 				level.actors[i].anim_milli = 0;
 
 		{
-			const s32 x = offset.x + level.map.dim.x * TILE_SIZE / 2;
-			s32 y = offset.y - 40;
+			const s32 x = screen.x / 2;
+			s32 y = max(offset.y, TILE_BORDER_DIM * TILE_SIZE) - 40;
 			for (u32 i = 0; i < num_players; ++i) {
 				struct player *player = &players[i];
 				if (player->pending_action != ACTION_COUNT) {
@@ -929,97 +1023,111 @@ void play(u32 frame_milli)
 			}
 		}
 
+		if (num_players == 1)
+			timeline();
+
 		if (key_pressed(gui, key_prev)) {
-			array_clear(dissolve_effects);
-			array_clear(door_effects);
-			level_idx = (level_idx + array_sz(maps) - 1) % array_sz(maps);
-			level_init(&level, players, &maps[level_idx]);
-			background_generate(&bg_effects, screen);
+			particles_clear(&dissolve_fx);
+			particles_clear(&door_fx);
+			level_start((level_idx + map_pack_sz(&pack) - 1) % map_pack_sz(&pack));
+			background_generate(&bg_fx, screen);
 		} else if (key_pressed(gui, key_next)) {
-			array_clear(dissolve_effects);
-			array_clear(door_effects);
-			level_idx = (level_idx + 1) % array_sz(maps);
-			level_init(&level, players, &maps[level_idx]);
-			background_generate(&bg_effects, screen);
+			particles_clear(&dissolve_fx);
+			particles_clear(&door_fx);
+			level_start((level_idx + 1) % map_pack_sz(&pack));
+			background_generate(&bg_fx, screen);
 		}
 	}
 
 
 	if (!level.complete) {
 		const r32 dt = (r32)frame_milli / STONE_GLOW_EFFECT_DURATION_MILLI;
-		for (s32 i = 0; i < level.map.dim.y; ++i)
-			for (s32 j = 0; j < level.map.dim.x; ++j)
-				if (   level.map.tiles[i][j].type == TILE_HALL
-				    || level.map.tiles[i][j].type == TILE_DOOR)
-					level.map.tiles[i][j].t = max(level.map.tiles[i][j].t - dt, 0.f);
+		v2i actor_pos[ACTOR_CNT_MAX];
+
+		profile_begin("actors");
+		for (u32 i = 0; i < array_sz(lit_tiles); ) {
+			struct glow *lit = &lit_tiles[i];
+			lit->t = max(lit->t - dt, 0.f);
+			if (lit->t == 0.f) {
+				*lit_slot(lit->tile) = 0;
+				array_remove_fast(lit_tiles, i);
+				if (i < array_sz(lit_tiles))
+					*lit_slot(lit_tiles[i].tile) = i + 1;
+			} else {
+				++i;
+			}
+		}
 
 		for (u32 i = 0; i < level.num_actors; ++i) {
-			const v2i p = level.actors[i].tile;
-			level.map.tiles[p.y][p.x].active_color = g_tile_fills[TILE_ACTOR];
-			level.map.tiles[p.y][p.x].t = 1.f;
-			for (u32 j = 0; j < level.actors[i].num_clones; ++j) {
-				const v2i p2 = v2i_add(p, level.actors[i].clones[j].pos);
-				level.map.tiles[p2.y][p2.x].active_color
-					= level.actors[i].clones[j].required ? g_tile_fills[TILE_CLONE2] : g_tile_fills[TILE_CLONE];
-				level.map.tiles[p2.y][p2.x].t = 1.f;
-			}
+			actor_pos[i] = v2i_add(offset, actor_draw_pos(&level.actors[i], sim_lag_milli));
+			light_tile(level.actors[i].tile, g_tile_fills[TILE_ACTOR]);
 		}
 
 		for (u32 i = 0; i < level.num_clones; ++i) {
-			const v2i pos = v2i_add(offset, v2i_scale(level.clones[i].pos, TILE_SIZE));
-			render_clone(gui, pos, level.clones[i].required, DIR_DOWN, 0);
+			const u32 owner = level.clone_owner[i];
+			const b32 required = level.clone_required[i];
+			v2i pos;
+			if (owner == ACTOR_NONE) {
+				pos = v2i_add(offset, v2i_scale(level.clone_pos[i], TILE_SIZE));
+				if (on_screen(pos, screen))
+					render_clone(&sprite_batch, pos, required, DIR_DOWN, 0);
+			} else {
+				const struct actor *actor = &level.actors[owner];
+				light_tile(level_clone_tile(&level, i),
+				           required ? g_tile_fills[TILE_CLONE2] : g_tile_fills[TILE_CLONE]);
+				pos = v2i_add(actor_pos[owner], v2i_scale(level.clone_pos[i], TILE_SIZE));
+				if (on_screen(pos, screen))
+					render_clone(&sprite_batch, pos, required, actor->facing, actor->anim_milli);
+			}
 		}
 
 		for (u32 i = 0; i < level.num_actors; ++i) {
 			const struct actor *actor = &level.actors[i];
-			const v2i actor_pos = v2i_add(offset, v2f_to_v2i(actor->pos));
-			render_actor(gui, actor_pos, actor->facing, actor->anim_milli);
-			for (u32 j = 0; j < actor->num_clones; ++j) {
-				const struct clone *clone = &actor->clones[j];
-				const v2i clone_pos = v2i_add(actor_pos, v2i_scale(clone->pos, TILE_SIZE));
-				render_clone(gui, clone_pos, clone->required, actor->facing, actor->anim_milli);
-			}
+			if (on_screen(actor_pos[i], screen))
+				render_actor(&sprite_batch, actor_pos[i], actor->facing, actor->anim_milli);
 		}
+		sprite_batch_flush(&sprite_batch, gui, &sprite_atlas);
+		profile_end();
 	}
 
 
 	if (!level.complete && level_complete(&level)) {
-		for (s32 i = 0; i < level.map.dim.y; ++i) {
-			for (s32 j = 0; j < level.map.dim.x; ++j) {
+		v2i first, last;
+		map_view_bounds(level.map.dim, screen, offset, &first, &last);
+		for (s32 i = first.y; i < last.y; ++i) {
+			for (s32 j = first.x; j < last.x; ++j) {
 				const v2i tile = { .x = j, .y = i };
-				if (level.map.tiles[i][j].type == TILE_HALL)
-					dissolve_effect_add(&dissolve_effects, offset, tile,
-					                    g_tile_fills[level.map.tiles[i][j].type],
+				if (map_tile_type(&level.map, i, j) == TILE_HALL)
+					dissolve_effect_add(&dissolve_fx, offset, tile,
+					                    g_tile_fills[TILE_HALL],
 					                    LEVEL_COMPLETE_EFFECT_DURATION_MILLI);
 			}
 		}
-		for (u32 i = 0; i < level.num_actors; ++i) {
-			const struct actor *actor = &level.actors[i];
-			dissolve_effect_add(&dissolve_effects, offset, actor->tile,
+		for (u32 i = 0; i < level.num_actors; ++i)
+			dissolve_effect_add(&dissolve_fx, offset, level.actors[i].tile,
 			                    g_tile_fills[TILE_ACTOR],
 			                    LEVEL_COMPLETE_EFFECT_DURATION_MILLI);
-			for (u32 j = 0; j < actor->num_clones; ++j) {
-				const struct clone *clone = &actor->clones[j];
-				dissolve_effect_add(&dissolve_effects, offset,
-				                    v2i_add(actor->tile, clone->pos),
-				                    clone->required ? g_tile_fills[TILE_CLONE2] : g_tile_fills[TILE_CLONE],
+		for (u32 i = 0; i < level.num_clones; ++i)
+			if (level.clone_owner[i] != ACTOR_NONE)
+				dissolve_effect_add(&dissolve_fx, offset, level_clone_tile(&level, i),
+				                      level.clone_required[i]
+				                    ? g_tile_fills[TILE_CLONE2] : g_tile_fills[TILE_CLONE],
 				                    LEVEL_COMPLETE_EFFECT_DURATION_MILLI);
-			}
-		}
 		sound_play(&sound_success);
 		level.complete = true;
-		array_foreach(door_effects, struct effect2, fx)
-			if (fx->t < 1.f)
-				fx->t = 2.f - fx->t;
+		for (u32 i = 0; i < door_fx.cnt; ++i)
+			if (door_fx.t[i] < 1.f)
+				door_fx.t[i] = 2.f - door_fx.t[i];
 	}
 
-	if (level.complete && array_empty(dissolve_effects)) {
-		level_idx = (level_idx + 1) % array_sz(maps);
-		level_init(&level, players, &maps[level_idx]);
-		background_generate(&bg_effects, screen);
+	if (level.complete && dissolve_fx.cnt == 0) {
+		level_start((level_idx + 1) % map_pack_sz(&pack));
+		background_generate(&bg_fx, screen);
 	}
 
-	if (key_pressed(gui, KB_F1) && !is_key_bound(KB_F1)) {
+	if (   key_pressed(gui, KB_F1)
+	    && !is_key_bound(KB_F1)
+	    && (pack.maps == &maps || load_maps(g_current_maps_file_name, &maps))) {
 		editor_edit_map(&maps, level_idx);
 		mode = EDIT;
 	}
@@ -0,0 +1,246 @@
+#include "config.h"
+#include "core.h"
+#include "action.h"
+#include "types.h"
+#include "map.h"
+
+/*
+ * Tiles are stored in MAP_CHUNK_DIM x MAP_CHUNK_DIM chunks, allocated only
+ * once a non-blank tile is written to them.  Reads of a missing chunk see
+ * blank tiles.
+ *
+ * Chunks are reference counted and shared between copies of a map, so a
+ * copy costs a pointer per chunk.  A shared chunk is duplicated the first
+ * time one of its owners writes to it.  The counts are not atomic - maps
+ * sharing chunks must stay on one thread.
+ *
+ * Tiles of an edge chunk that fall outside the map's dim are always blank.
+ */
+
+static const struct tile g_tile_blank = { .type = TILE_BLANK };
+
+static
+v2i map__chunk_dim(v2i dim)
+{
+	return (v2i){
+		.x = (dim.x + MAP_CHUNK_DIM - 1) / MAP_CHUNK_DIM,
+		.y = (dim.y + MAP_CHUNK_DIM - 1) / MAP_CHUNK_DIM,
+	};
+}
+
+static
+u32 map__chunk_cnt(v2i dim)
+{
+	const v2i chunk_dim = map__chunk_dim(dim);
+	return chunk_dim.x * chunk_dim.y;
+}
+
+static
+u32 map__chunk_idx(const struct map *map, s32 i, s32 j)
+{
+	const v2i chunk_dim = map__chunk_dim(map->dim);
+	return (i / MAP_CHUNK_DIM) * chunk_dim.x + j / MAP_CHUNK_DIM;
+}
+
+static
+struct tile_chunk *map__chunk_share(struct tile_chunk *chunk)
+{
+	if (chunk)
+		++chunk->refs;
+	return chunk;
+}
+
+static
+void map__chunk_release(struct tile_chunk *chunk)
+{
+	if (chunk && --chunk->refs == 0)
+		free(chunk);
+}
+
+void map_init(struct map *map, v2i dim)
+{
+	const u32 n = map__chunk_cnt(dim);
+	assert(dim.x >= 0 && dim.x <= MAP_DIM_MAX);
+	assert(dim.y >= 0 && dim.y <= MAP_DIM_MAX);
+	map->dim = dim;
+	map->chunks = n ? calloc(n, sizeof(struct tile_chunk*)) : NULL;
+}
+
+void map_copy(struct map *dst, const struct map *src)
+{
+	const u32 n = map__chunk_cnt(src->dim);
+
+	if (dst == src)
+		return;
+
+	map_destroy(dst);
+	memcpy(dst->tip, src->tip, MAP_TIP_MAX);
+	memcpy(dst->desc, src->desc, MAP_TIP_MAX);
+	memcpy(dst->actor_controlled_by_player, src->actor_controlled_by_player,
+	       sizeof(src->actor_controlled_by_player));
+	map_init(dst, src->dim);
+	for (u32 i = 0; i < n; ++i)
+		dst->chunks[i] = map__chunk_share(src->chunks[i]);
+}
+
+void map_destroy(struct map *map)
+{
+	const u32 n = map__chunk_cnt(map->dim);
+	if (map->chunks) {
+		for (u32 i = 0; i < n; ++i)
+			map__chunk_release(map->chunks[i]);
+		free(map->chunks);
+	}
+	map->chunks = NULL;
+	map->dim = g_v2i_zero;
+}
+
+/* Tiles of chunk (ci, cj) inside a map of the given dim */
+static
+v2i map__chunk_extent(v2i dim, s32 ci, s32 cj)
+{
+	return (v2i){
+		.x = min(MAP_CHUNK_DIM, dim.x - cj * MAP_CHUNK_DIM),
+		.y = min(MAP_CHUNK_DIM, dim.y - ci * MAP_CHUNK_DIM),
+	};
+}
+
+/* With a chunk-aligned offset, every chunk whose tiles all stay inside the
+ * map moves over shared rather than copied. */
+static
+void map__resize_aligned(struct map *resized, const struct map *map, v2i offset)
+{
+	const v2i chunk_dim = map__chunk_dim(map->dim);
+	const v2i chunk_offset = v2i_scale_inv(offset, MAP_CHUNK_DIM);
+
+	for (s32 ci = 0; ci < chunk_dim.y; ++ci) {
+		for (s32 cj = 0; cj < chunk_dim.x; ++cj) {
+			struct tile_chunk *chunk = map->chunks[ci * chunk_dim.x + cj];
+			const s32 ri = ci + chunk_offset.y, rj = cj + chunk_offset.x;
+			v2i extent, resized_extent;
+
+			if (!chunk || ri < 0 || rj < 0)
+				continue;
+
+			extent = map__chunk_extent(map->dim, ci, cj);
+			resized_extent = map__chunk_extent(resized->dim, ri, rj);
+			if (resized_extent.x >= extent.x && resized_extent.y >= extent.y) {
+				resized->chunks[map__chunk_idx(resized, ri * MAP_CHUNK_DIM, rj * MAP_CHUNK_DIM)]
+					= map__chunk_share(chunk);
+				continue;
+			}
+
+			for (s32 i = 0; i < min(extent.y, resized_extent.y); ++i) {
+				for (s32 j = 0; j < min(extent.x, resized_extent.x); ++j) {
+					const struct tile *tile = &chunk->tiles[i][j];
+					if (tile->type != TILE_BLANK)
+						*map_tile_mut(resized, ri * MAP_CHUNK_DIM + i,
+						              rj * MAP_CHUNK_DIM + j) = *tile;
+				}
+			}
+		}
+	}
+}
+
+/* Tile (i, j) of the old map ends up at (i + offset.y, j + offset.x) */
+void map_resize(struct map *map, v2i dim, v2i offset)
+{
+	struct map resized = { 0 };
+
+	map_init(&resized, dim);
+	if (offset.x % MAP_CHUNK_DIM == 0 && offset.y % MAP_CHUNK_DIM == 0) {
+		map__resize_aligned(&resized, map, offset);
+	} else {
+		for (s32 i = max(0, -offset.y); i < min(map->dim.y, dim.y - offset.y); ++i) {
+			for (s32 j = max(0, -offset.x); j < min(map->dim.x, dim.x - offset.x); ++j) {
+				const struct tile *tile = map_tile(map, i, j);
+				if (tile->type != TILE_BLANK)
+					*map_tile_mut(&resized, i + offset.y, j + offset.x) = *tile;
+			}
+		}
+	}
+
+	map_destroy(map);
+	map->dim = resized.dim;
+	map->chunks = resized.chunks;
+}
+
+const struct tile *map_tile(const struct map *map, s32 i, s32 j)
+{
+	const struct tile_chunk *chunk;
+	assert(i >= 0 && i < map->dim.y && j >= 0 && j < map->dim.x);
+	chunk = map->chunks[map__chunk_idx(map, i, j)];
+	return chunk ? &chunk->tiles[i % MAP_CHUNK_DIM][j % MAP_CHUNK_DIM] : &g_tile_blank;
+}
+
+struct tile *map_tile_mut(struct map *map, s32 i, s32 j)
+{
+	struct tile_chunk **chunk;
+	assert(i >= 0 && i < map->dim.y && j >= 0 && j < map->dim.x);
+	chunk = &map->chunks[map__chunk_idx(map, i, j)];
+	if (!*chunk) {
+		*chunk = calloc(1, sizeof(struct tile_chunk));
+		(*chunk)->refs = 1;
+	} else if ((*chunk)->refs > 1) {
+		struct tile_chunk *copy = malloc(sizeof(struct tile_chunk));
+		*copy = **chunk;
+		copy->refs = 1;
+		map__chunk_release(*chunk);
+		*chunk = copy;
+	}
+	return &(*chunk)->tiles[i % MAP_CHUNK_DIM][j % MAP_CHUNK_DIM];
+}
+
+enum tile_type map_tile_type(const struct map *map, s32 i, s32 j)
+{
+	return map_tile(map, i, j)->type;
+}
+
+void map_set_tile_type(struct map *map, s32 i, s32 j, enum tile_type type)
+{
+	if (map_tile_type(map, i, j) != type)
+		map_tile_mut(map, i, j)->type = type;
+}
+
+/* Chunk coordinates are tile coordinates divided by MAP_CHUNK_DIM */
+b32 map_chunk_blank(const struct map *map, v2i chunk)
+{
+	return map->chunks[map__chunk_idx(map, chunk.y * MAP_CHUNK_DIM,
+	                                  chunk.x * MAP_CHUNK_DIM)] == NULL;
+}
+
+void map_array_clear(array(struct map) *maps)
+{
+	array_foreach(*maps, struct map, map)
+		map_destroy(map);
+	array_clear(*maps);
+}
+
+static
+s32 map__view_offset(s32 dim, s32 screen, s32 focus)
+{
+	const s32 margin = TILE_BORDER_DIM * TILE_SIZE;
+	const s32 sz = dim * TILE_SIZE;
+	if (sz <= screen)
+		return (screen - sz) / 2;
+	return clamp(screen - margin - sz, screen / 2 - focus, margin);
+}
+
+/* Centers maps that fit on screen, otherwise scrolls to keep the focus
+ * point (in pixels from the map origin) centered */
+v2i map_view_offset(v2i dim, v2i screen, v2i focus)
+{
+	return (v2i){
+		.x = map__view_offset(dim.x, screen.x, focus.x),
+		.y = map__view_offset(dim.y, screen.y, focus.y),
+	};
+}
+
+/* Range of tiles [first, last) at least partially on screen */
+void map_view_bounds(v2i dim, v2i screen, v2i offset, v2i *first, v2i *last)
+{
+	first->x = clamp(0, -offset.x / TILE_SIZE, dim.x);
+	first->y = clamp(0, -offset.y / TILE_SIZE, dim.y);
+	last->x = clamp(0, (screen.x - offset.x + TILE_SIZE - 1) / TILE_SIZE, dim.x);
+	last->y = clamp(0, (screen.y - offset.y + TILE_SIZE - 1) / TILE_SIZE, dim.y);
+}
@@ -0,0 +1,15 @@
+void map_init(struct map *map, v2i dim);
+void map_copy(struct map *dst, const struct map *src);
+void map_destroy(struct map *map);
+void map_resize(struct map *map, v2i dim, v2i offset);
+
+const struct tile *map_tile(const struct map *map, s32 i, s32 j);
+struct tile      *map_tile_mut(struct map *map, s32 i, s32 j);
+enum tile_type    map_tile_type(const struct map *map, s32 i, s32 j);
+void              map_set_tile_type(struct map *map, s32 i, s32 j, enum tile_type type);
+b32               map_chunk_blank(const struct map *map, v2i chunk);
+
+void map_array_clear(array(struct map) *maps);
+
+v2i  map_view_offset(v2i dim, v2i screen, v2i focus);
+void map_view_bounds(v2i dim, v2i screen, v2i offset, v2i *first, v2i *last);
@@ -0,0 +1,30 @@
+#include "config.h"
+#include "core.h"
+#include "action.h"
+#include "types.h"
+#include "disk.h"
+#include "map.h"
+
+/* Compiles a .vson map pack into the binary .cmap format loaded by the game */
+int main(int argc, char *const argv[])
+{
+	array(struct map) maps;
+	int ret = 0;
+
+	if (argc != 3) {
+		fprintf(stderr, "usage: %s <maps.vson> <maps.cmap>\n", argv[0]);
+		return 1;
+	}
+
+	maps = array_create();
+	if (!load_maps_vson(argv[1], &maps)) {
+		fprintf(stderr, "failed to load maps from %s\n", argv[1]);
+		ret = 1;
+	} else if (!save_maps_cmap(argv[2], maps)) {
+		fprintf(stderr, "failed to write %s\n", argv[2]);
+		ret = 1;
+	}
+	map_array_clear(&maps);
+	array_destroy(maps);
+	return ret;
+}
@@ -0,0 +1,90 @@
+#include "config.h"
+#include "core.h"
+#define STB_IMAGE_IMPLEMENTATION
+#include "violet/stb_image.h"
+#include "action.h"
+#include "types.h"
+#include "disk.h"
+
+/*
+ * Packs game assets into one .pak archive for the game to map at startup.
+ * Each file is stored under the path it was given, which must be the path
+ * the game loads it by.  PNGs are stored decoded so the game skips stbi.
+ */
+
+static
+b32 pack__read(const char *filename, struct archive_file *file)
+{
+	const char *ext = strrchr(filename, '.');
+	FILE *fp;
+	long sz;
+	int w, h, comp;
+
+	file->name = filename;
+	file->dim = g_v2i_zero;
+
+	if (ext && strcmp(ext, ".png") == 0) {
+		file->data = stbi_load(filename, &w, &h, &comp, 4);
+		if (!file->data)
+			return false;
+		file->size = w * h * 4;
+		file->dim = (v2i){ .x = w, .y = h };
+		return true;
+	}
+
+	fp = fopen(filename, "rb");
+	if (!fp)
+		return false;
+	if (   fseek(fp, 0, SEEK_END) != 0
+	    || (sz = ftell(fp)) < 0
+	    || fseek(fp, 0, SEEK_SET) != 0)
+		goto err;
+	file->data = malloc(sz > 0 ? sz : 1);
+	file->size = sz;
+	if (sz > 0 && fread((void*)file->data, sz, 1, fp) != 1) {
+		free((void*)file->data);
+		goto err;
+	}
+	fclose(fp);
+	return true;
+
+err:
+	fclose(fp);
+	return false;
+}
+
+int main(int argc, char *const argv[])
+{
+	struct archive_file *files;
+	u32 n = 0;
+	int ret = 0;
+
+	if (argc < 3) {
+		fprintf(stderr, "usage: %s <out.pak> <files...>\n", argv[0]);
+		return 1;
+	}
+
+	files = calloc(argc - 2, sizeof(*files));
+	for (int i = 2; i < argc; ++i, ++n) {
+		if (!pack__read(argv[i], &files[n])) {
+			fprintf(stderr, "failed to read %s\n", argv[i]);
+			ret = 1;
+			goto out;
+		}
+	}
+
+	if (!save_archive(argv[1], files, n)) {
+		fprintf(stderr, "failed to write %s\n", argv[1]);
+		ret = 1;
+	}
+
+out:
+	for (u32 i = 0; i < n; ++i) {
+		if (files[i].dim.x > 0)
+			stbi_image_free((void*)files[i].data);
+		else
+			free((void*)files[i].data);
+	}
+	free(files);
+	return ret;
+}
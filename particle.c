@@ -0,0 +1,157 @@
+#include "config.h"
+#include "violet/all.h"
+#include "action.h"
+#include "types.h"
+#include "render_types.h"
+#include "particle.h"
+
+/*
+ * Particles live in fixed-capacity parallel arrays, one pool per kind.
+ * Updating a pool is a handful of straight loops over the float arrays
+ * which the compiler can vectorize; the per-kind shape of each particle
+ * is baked into size/alpha/rotation so drawing is a single loop.
+ * Adding to a full pool drops the particle.
+ */
+
+void particles_init(struct particles *p, enum particle_kind kind, u32 cap)
+{
+	r32 *block = malloc(cap * (9 * sizeof(r32) + sizeof(color_t)));
+	p->kind = kind;
+	p->cnt = 0;
+	p->cap = cap;
+	p->x              = block;
+	p->y              = block + cap;
+	p->t              = block + 2 * cap;
+	p->rate           = block + 3 * cap;
+	p->rotation_start = block + 4 * cap;
+	p->rotation_rate  = block + 5 * cap;
+	p->size           = block + 6 * cap;
+	p->alpha          = block + 7 * cap;
+	p->rotation       = block + 8 * cap;
+	p->color          = (color_t*)(block + 9 * cap);
+}
+
+void particles_destroy(struct particles *p)
+{
+	free(p->x);
+	p->x = NULL;
+	p->cnt = 0;
+	p->cap = 0;
+}
+
+void particles_clear(struct particles *p)
+{
+	p->cnt = 0;
+}
+
+b32 particles_add(struct particles *p, v2f pos, color_t color, r32 t, u32 duration,
+                  r32 rotation_start, r32 rotation_rate)
+{
+	const u32 i = p->cnt;
+	if (i == p->cap)
+		return false;
+	p->x[i] = pos.x;
+	p->y[i] = pos.y;
+	p->t[i] = t;
+	p->rate[i] = 1.f / duration;
+	p->rotation_start[i] = rotation_start;
+	p->rotation_rate[i] = rotation_rate;
+	p->color[i] = color;
+	p->size[i] = 0.f;
+	p->alpha[i] = 0.f;
+	p->rotation[i] = rotation_start;
+	++p->cnt;
+	return true;
+}
+
+/* Moves the last particle into each expired slot, like array_remove_fast */
+static
+void particles__expire(struct particles *p, r32 t_max)
+{
+	for (u32 i = 0; i < p->cnt; ) {
+		if (p->t[i] > t_max) {
+			const u32 last = --p->cnt;
+			p->x[i] = p->x[last];
+			p->y[i] = p->y[last];
+			p->t[i] = p->t[last];
+			p->rate[i] = p->rate[last];
+			p->rotation_start[i] = p->rotation_start[last];
+			p->rotation_rate[i] = p->rotation_rate[last];
+			p->color[i] = p->color[last];
+		} else {
+			++i;
+		}
+	}
+}
+
+void particles_update(struct particles *p, u32 frame_milli)
+{
+	const r32 milli = frame_milli;
+	r32 *t = p->t;
+	const r32 *rate = p->rate;
+	r32 *size = p->size;
+	r32 *alpha = p->alpha;
+	u32 n = p->cnt;
+
+	for (u32 i = 0; i < n; ++i)
+		t[i] += milli * rate[i];
+
+	switch (p->kind) {
+	case PARTICLE_PULSE:
+		for (u32 i = 0; i < n; ++i)
+			t[i] = t[i] > 2.f ? 0.f : t[i];
+		for (u32 i = 0; i < n; ++i) {
+			const r32 w = 1.f - fabsf(1.f - t[i]);
+			size[i] = TILE_SIZE;
+			alpha[i] = 48.f * w + 16.f;
+		}
+	break;
+	case PARTICLE_SPIN: {
+		const r32 *rotation_start = p->rotation_start;
+		const r32 *rotation_rate = p->rotation_rate;
+		r32 *rotation = p->rotation;
+		particles__expire(p, 2.f);
+		n = p->cnt;
+		for (u32 i = 0; i < n; ++i) {
+			const r32 w = 1.f - fabsf(1.f - t[i]);
+			size[i] = TILE_SIZE / 2 * w;
+			alpha[i] = 48.f * w + 48.f;
+			rotation[i] = rotation_start[i] + rotation_rate[i] * t[i];
+		}
+	}
+	break;
+	case PARTICLE_DISSOLVE:
+		particles__expire(p, 1.f);
+		n = p->cnt;
+		for (u32 i = 0; i < n; ++i) {
+			const r32 w = 1.f - t[i];
+			size[i] = (TILE_SIZE - 4) * w;
+			alpha[i] = 255.f * w;
+		}
+	break;
+	}
+}
+
+void particles_draw(const struct particles *p, gui_t *gui)
+{
+	for (u32 i = 0; i < p->cnt; ++i) {
+		const r32 sz = p->size[i];
+		color_t fill = p->color[i];
+		fill.a = p->alpha[i];
+		if (p->kind == PARTICLE_SPIN) {
+			const r32 c = cosf(p->rotation[i]) * sz / 2;
+			const r32 s = sinf(p->rotation[i]) * sz / 2;
+			const v2f square[4] = {
+				{ .x = p->x[i] + c - s, .y = p->y[i] + s + c },
+				{ .x = p->x[i] - c - s, .y = p->y[i] - s + c },
+				{ .x = p->x[i] - c + s, .y = p->y[i] - s - c },
+				{ .x = p->x[i] + c + s, .y = p->y[i] + s - c },
+			};
+			gui_polyf(gui, square, 4, fill, g_nocolor);
+		} else {
+			const s32 isz = sz;
+			gui_rect(gui, (s32)p->x[i] - isz / 2, (s32)p->y[i] - isz / 2,
+			         isz, isz, fill, g_nocolor);
+		}
+	}
+}
@@ -0,0 +1,7 @@
+void particles_init(struct particles *p, enum particle_kind kind, u32 cap);
+void particles_destroy(struct particles *p);
+void particles_clear(struct particles *p);
+b32  particles_add(struct particles *p, v2f pos, color_t color, r32 t, u32 duration,
+                   r32 rotation_start, r32 rotation_rate);
+void particles_update(struct particles *p, u32 frame_milli);
+void particles_draw(const struct particles *p, gui_t *gui);
@@ -1,69 +1,104 @@
 #include "config.h"
-#include "violet/all.h"
+#include "core.h"
 #include "action.h"
 #include "types.h"
 #include "player.h"
 #include "history.h"
-#include "settings.h"
 
-void player_init(struct player *player, u32 idx)
+void player_init(struct player *player)
 {
 	player->num_actors = 0;
-	player->key_bindings = g_key_bindings[idx];
 	player->last_action = ACTION_COUNT;
 	player->pending_action = ACTION_COUNT;
-	history_clear(&player->history);
+	player->input_head = 0;
+	player->num_inputs = 0;
+	player->actions_held = 0;
 }
 
-b32 player_desires_action(struct player *player, enum action action,
-                          const gui_t *gui)
+/* For a level (re)start: the keys held & their repeat carry on */
+void player_reset(struct player *player)
 {
-	const u32 frame_milli = gui_frame_time_milli(gui);
+	player->num_actors = 0;
+	player->pending_action = ACTION_COUNT;
+	player_input_clear(player);
+}
 
-	if (gui_any_widget_has_focus(gui)) {
-		return false;
-	} else if (!key_down(gui, player->key_bindings[action])) {
-		if (player->last_action == action)
-			player->last_action = ACTION_COUNT;
-		return false;
-	} else if (player->last_action == ACTION_COUNT) {
-		player->last_action = action;
-		player->action_repeat_timer = ACTION_REPEAT_INTERVAL;
-		return true;
-	} else if (action != player->last_action) {
-		return false;
-	} else if (player->action_repeat_timer <= frame_milli) {
-		player->action_repeat_timer =   ACTION_REPEAT_INTERVAL
-		                              - (frame_milli - player->action_repeat_timer);
-		return true;
-	} else {
-		player->action_repeat_timer -= frame_milli;
-		return false;
+void player_destroy(struct player *player)
+{
+	history_destroy(&player->history);
+}
+
+/*
+ * Key presses are queued as they arrive rather than sampled once a frame,
+ * so a press made while the actors are still walking is acted on in the
+ * tick they arrive, and a press and release within one frame is not lost.
+ */
+
+void player_input_press(struct player *player, enum action action, u32 time)
+{
+	struct input *input;
+	if (player->num_inputs == INPUT_QUEUE_MAX) {
+		player->input_head = (player->input_head + 1) % INPUT_QUEUE_MAX;
+		--player->num_inputs;
+	}
+	input = &player->inputs[(player->input_head + player->num_inputs) % INPUT_QUEUE_MAX];
+	input->action = action;
+	input->time = time;
+	++player->num_inputs;
+	player->actions_held |= 1 << action;
+}
+
+void player_input_release(struct player *player, enum action action)
+{
+	player->actions_held &= ~(1 << action);
+	if (player->last_action != action)
+		return;
+	/* keep walking if another direction is still held */
+	player->last_action = ACTION_COUNT;
+	for (u32 i = ACTION_MOVE_UP; i <= ACTION_MOVE_RIGHT; ++i) {
+		if (player->actions_held & (1 << i)) {
+			player->last_action = i;
+			player->action_repeat_timer = 0;
+			break;
+		}
 	}
 }
 
-enum action player_desired_action(struct player *player, const gui_t *gui)
+void player_input_clear(struct player *player)
+{
+	player->input_head = 0;
+	player->num_inputs = 0;
+}
+
+enum action player_next_action(struct player *player, u32 now, u32 milli)
 {
 	for (u32 j = 0; j < player->num_actors; ++j)
 		if (player->actors[j]->dir != DIR_NONE)
 			return ACTION_COUNT;
 
-	if (key_down(gui, player->key_bindings[ACTION_MOVE_UP]))
-		return ACTION_MOVE_UP;
-	else if (key_down(gui, player->key_bindings[ACTION_MOVE_DOWN]))
-		return ACTION_MOVE_DOWN;
-	else if (key_down(gui, player->key_bindings[ACTION_MOVE_LEFT]))
-		return ACTION_MOVE_LEFT;
-	else if (key_down(gui, player->key_bindings[ACTION_MOVE_RIGHT]))
-		return ACTION_MOVE_RIGHT;
-	else if (player_desires_action(player, ACTION_ROTATE_CCW, gui))
-		return ACTION_ROTATE_CCW;
-	else if (player_desires_action(player, ACTION_ROTATE_CW, gui))
-		return ACTION_ROTATE_CW;
-	else if (player_desires_action(player, ACTION_UNDO, gui))
-		return ACTION_UNDO;
-	else if (key_pressed(gui, player->key_bindings[ACTION_RESET]))
-		return ACTION_RESET;
-	else
+	while (player->num_inputs > 0) {
+		const struct input input = player->inputs[player->input_head];
+		player->input_head = (player->input_head + 1) % INPUT_QUEUE_MAX;
+		--player->num_inputs;
+		if (now - input.time > INPUT_BUFFER_MILLI)
+			continue;
+		player->last_action = input.action;
+		player->action_repeat_timer =   action_is_move(input.action)
+		                              ? 0 : ACTION_REPEAT_INTERVAL;
+		return input.action;
+	}
+
+	/* a held move walks on without pause, others repeat at an interval */
+	if (   player->last_action == ACTION_COUNT
+	    || player->last_action == ACTION_RESET
+	    || !(player->actions_held & (1 << player->last_action))) {
 		return ACTION_COUNT;
+	} else if (player->action_repeat_timer <= milli) {
+		player->action_repeat_timer =   action_is_move(player->last_action)
+		                              ? 0 : ACTION_REPEAT_INTERVAL;
+		return player->last_action;
+	} else {
+		player->action_repeat_timer -= milli;
+		return ACTION_COUNT;
+	}
 }
@@ -1,4 +1,7 @@
-void player_init(struct player *player, u32 idx);
-b32  player_desires_action(struct player *player, enum action action,
-                           const gui_t *gui);
-enum action player_desired_action(struct player *player, const gui_t *gui);
+void player_init(struct player *player);
+void player_reset(struct player *player);
+void player_destroy(struct player *player);
+void player_input_press(struct player *player, enum action action, u32 time);
+void player_input_release(struct player *player, enum action action);
+void player_input_clear(struct player *player);
+enum action player_next_action(struct player *player, u32 now, u32 milli);
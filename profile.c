@@ -0,0 +1,198 @@
+#include <SDL.h>
+#include "config.h"
+#include "violet/all.h"
+#include "profile.h"
+#ifdef PROFILE
+
+/*
+ * Each frame records its zones into a slot of a ring holding the last
+ * PROFILE_FRAME_CNT frames, so nothing is allocated while running.  A
+ * frame lasts from one profile_frame_begin() to the next: zones after
+ * profile_frame_end() (the main loop's wait & sleep) still belong to it,
+ * but only the time up to profile_frame_end() counts as busy.
+ * Zones past PROFILE_ZONE_CNT_MAX in a frame are dropped.
+ */
+
+#define PROFILE__NONE (~0u)
+
+struct profile__zone
+{
+	const char *name;
+	u64 start, end;
+	u32 depth;
+};
+
+struct profile__frame
+{
+	u64 start, end, next;
+	u32 num_zones;
+	struct profile__zone zones[PROFILE_ZONE_CNT_MAX];
+};
+
+static struct profile__frame g_frames[PROFILE_FRAME_CNT];
+static u32 g_frame_idx = 0;  /* frame being recorded */
+static u32 g_num_frames = 0; /* finished frames, behind g_frame_idx */
+static u32 g_open[PROFILE_DEPTH_MAX];
+static u32 g_depth = 0;
+
+
+static
+r32 profile__milli(u64 start, u64 end)
+{
+	return (r32)((r64)(end - start) * 1000.0 / SDL_GetPerformanceFrequency());
+}
+
+static
+int profile__cmp(const void *lhs_, const void *rhs_)
+{
+	const r32 lhs = *(const r32*)lhs_, rhs = *(const r32*)rhs_;
+	return lhs < rhs ? -1 : lhs > rhs;
+}
+
+static
+const struct profile__frame *profile__frame(u32 i)
+{
+	return &g_frames[(g_frame_idx + PROFILE_FRAME_CNT - g_num_frames + i) % PROFILE_FRAME_CNT];
+}
+
+void profile_frame_begin(void)
+{
+	const u64 now = SDL_GetPerformanceCounter();
+	struct profile__frame *frame = &g_frames[g_frame_idx];
+
+	if (frame->start != 0) {
+		/* zones still open never finished inside this frame */
+		while (g_depth > 0)
+			profile_end();
+		frame->next = now;
+		g_frame_idx = (g_frame_idx + 1) % PROFILE_FRAME_CNT;
+		if (g_num_frames < PROFILE_FRAME_CNT - 1)
+			++g_num_frames;
+		frame = &g_frames[g_frame_idx];
+	}
+
+	frame->start = now;
+	frame->end = now;
+	frame->next = now;
+	frame->num_zones = 0;
+}
+
+void profile_frame_end(void)
+{
+	g_frames[g_frame_idx].end = SDL_GetPerformanceCounter();
+}
+
+void profile_begin(const char *name)
+{
+	struct profile__frame *frame = &g_frames[g_frame_idx];
+	u32 idx = PROFILE__NONE;
+
+	if (frame->num_zones < PROFILE_ZONE_CNT_MAX && g_depth < PROFILE_DEPTH_MAX) {
+		struct profile__zone *zone = &frame->zones[frame->num_zones];
+		idx = frame->num_zones++;
+		zone->name = name;
+		zone->depth = g_depth;
+		zone->start = SDL_GetPerformanceCounter();
+		zone->end = zone->start;
+	}
+
+	if (g_depth < PROFILE_DEPTH_MAX)
+		g_open[g_depth] = idx;
+	++g_depth;
+}
+
+void profile_end(void)
+{
+	if (g_depth == 0) {
+		assert(false);
+		return;
+	}
+
+	--g_depth;
+	if (g_depth < PROFILE_DEPTH_MAX && g_open[g_depth] != PROFILE__NONE)
+		g_frames[g_frame_idx].zones[g_open[g_depth]].end = SDL_GetPerformanceCounter();
+}
+
+/* Writes the ring as complete ('X') events in Chrome's trace_event format,
+ * for chrome://tracing or Perfetto. */
+b32 profile_export(const char *path)
+{
+	const r64 to_micro = 1000000.0 / SDL_GetPerformanceFrequency();
+	FILE *fp;
+	u64 base;
+	b32 first = true;
+
+	if (g_num_frames == 0)
+		return false;
+
+	fp = fopen(path, "w");
+	if (!fp) {
+		log_error("Cannot create trace file '%s'", path);
+		return false;
+	}
+
+	base = profile__frame(0)->start;
+	fprintf(fp, "{\"traceEvents\":[\n");
+	for (u32 i = 0; i < g_num_frames; ++i) {
+		const struct profile__frame *frame = profile__frame(i);
+		fprintf(fp, "%s{\"name\":\"frame\",\"ph\":\"X\",\"pid\":1,\"tid\":1,"
+		        "\"ts\":%.3f,\"dur\":%.3f}", first ? "" : ",\n",
+		        (frame->start - base) * to_micro, (frame->end - frame->start) * to_micro);
+		first = false;
+		for (u32 j = 0; j < frame->num_zones; ++j) {
+			const struct profile__zone *zone = &frame->zones[j];
+			fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,"
+			        "\"ts\":%.3f,\"dur\":%.3f}", zone->name,
+			        (zone->start - base) * to_micro, (zone->end - zone->start) * to_micro);
+		}
+	}
+	fprintf(fp, "\n]}\n");
+
+	if (fclose(fp) != 0) {
+		log_error("Cannot write trace file '%s'", path);
+		return false;
+	}
+	log_info("Wrote %u frames to '%s'", g_num_frames, path);
+	return true;
+}
+
+/* Frame & busy time percentiles over the ring, then the zones of the
+ * last finished frame, listed downwards from (x, y). */
+void profile_overlay(gui_t *gui, s32 x, s32 y, color_t color)
+{
+	static r32 busy[PROFILE_FRAME_CNT], total[PROFILE_FRAME_CNT];
+	const u32 n = g_num_frames;
+	const struct profile__frame *last;
+	char buf[64];
+
+	if (n == 0)
+		return;
+
+	for (u32 i = 0; i < n; ++i) {
+		const struct profile__frame *frame = profile__frame(i);
+		busy[i] = profile__milli(frame->start, frame->end);
+		total[i] = profile__milli(frame->start, frame->next);
+	}
+	qsort(busy, n, sizeof(busy[0]), profile__cmp);
+	qsort(total, n, sizeof(total[0]), profile__cmp);
+
+	snprintf(buf, sizeof(buf), "frame p50 %.1f p90 %.1f p99 %.1f max %.1f ms",
+	         total[n/2], total[n*9/10], total[n*99/100], total[n-1]);
+	gui_txt(gui, x, y, 12, buf, color, GUI_ALIGN_LEFT | GUI_ALIGN_TOP);
+	y -= 14;
+	snprintf(buf, sizeof(buf), "busy  p50 %.1f p90 %.1f p99 %.1f max %.1f ms",
+	         busy[n/2], busy[n*9/10], busy[n*99/100], busy[n-1]);
+	gui_txt(gui, x, y, 12, buf, color, GUI_ALIGN_LEFT | GUI_ALIGN_TOP);
+	y -= 14;
+
+	last = profile__frame(n - 1);
+	for (u32 i = 0; i < last->num_zones; ++i) {
+		const struct profile__zone *zone = &last->zones[i];
+		snprintf(buf, sizeof(buf), "%*s%s %.2f ms", 2 * zone->depth, "",
+		         zone->name, profile__milli(zone->start, zone->end));
+		gui_txt(gui, x, y, 12, buf, color, GUI_ALIGN_LEFT | GUI_ALIGN_TOP);
+		y -= 14;
+	}
+}
+
+#endif // PROFILE
@@ -0,0 +1,18 @@
+/*
+ * Frame-phase profiler, compiled in with PROFILE.  Zones nest, and the
+ * calls compile away entirely without the flag.
+ */
+
+#ifdef PROFILE
+void profile_frame_begin(void);
+void profile_frame_end(void);
+void profile_begin(const char *name);
+void profile_end(void);
+b32  profile_export(const char *path);
+void profile_overlay(gui_t *gui, s32 x, s32 y, color_t color);
+#else
+#define profile_frame_begin()
+#define profile_frame_end()
+#define profile_begin(name)
+#define profile_end()
+#endif
@@ -0,0 +1,81 @@
+/*
+ * Front end state: drawing, effects and anything else holding gui types.
+ * The game rules in types.h stay free of these so they build headless.
+ */
+
+/* Floor of one map chunk, baked into a texture */
+struct floor_chunk {
+	v2i pos;
+	u32 last_used;
+	img_t img;
+};
+
+/* Holds at least every chunk on screen, see floor_draw */
+struct floor_cache {
+	struct floor_chunk *chunks;
+	u32 num_chunks, cap;
+	u32 clock;
+};
+
+/* Rect within the atlas, in pixels from its top-left corner */
+struct sprite {
+	v2i pos;
+	v2i dim;
+};
+
+/* A sprite as drawn with one tint, uploaded the first time it's drawn */
+struct sprite_texture {
+	const struct sprite *sprite;
+	color_t tint;
+	img_t img;
+};
+
+/* RGBA pixels, rows top-first */
+struct sprite_atlas {
+	u8 *pixels;
+	v2i dim;
+	array(struct sprite_texture) textures;
+};
+
+/* Decoded RGBA pixels of one image, waiting to be packed into an atlas */
+struct sprite_image {
+	const u8 *pixels;
+	v2i dim;
+	b32 archived; /* pixels point into the asset archive */
+};
+
+struct sprite_draw {
+	v2i pos;
+	const struct sprite *sprite;
+	r32 scale;
+	color_t tint;
+	u32 texture; /* in the atlas, found at flush */
+};
+
+struct sprite_batch {
+	array(struct sprite_draw) draws;
+};
+
+/* Fading highlight of a tile an actor or clone stood on */
+struct glow {
+	v2i tile;
+	color_t color;
+	r32 t;
+};
+
+enum particle_kind {
+	PARTICLE_PULSE,    /* fades in and out, forever */
+	PARTICLE_SPIN,     /* grows and shrinks while rotating, once */
+	PARTICLE_DISSOLVE, /* shrinks and fades out, once */
+};
+
+struct particles {
+	enum particle_kind kind;
+	u32 cnt, cap;
+	r32 *x, *y;
+	r32 *t, *rate;
+	r32 *rotation_start, *rotation_rate;
+	color_t *color;
+	/* derived from t by particles_update */
+	r32 *size, *alpha, *rotation;
+};
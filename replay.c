@@ -0,0 +1,134 @@
+#include <time.h>
+#include "config.h"
+#include "core.h"
+#include "action.h"
+#include "types.h"
+#include "disk.h"
+#include "level.h"
+#include "player.h"
+#include "sim.h"
+
+/*
+ * Runs a recorded session through the game rules without a window or
+ * audio, to reproduce what a player saw or to time the simulation.
+ * The game records one when started with --record <file>.
+ */
+
+static
+void replay__run(const struct replay_run *run, struct map_pack *pack,
+                 struct level *level, struct player players[], u32 *num_moves)
+{
+	struct sim sim;
+
+	level_init(level, players, map_pack_get(pack, run->level_idx));
+	sim_init(&sim, level, players, run->num_players);
+
+	array_foreach(run->inputs, const struct sim_input, input) {
+		u32 events;
+
+		/* nothing changes while every actor stands still, so skip ahead */
+		while (sim.tick < input->tick) {
+			if (sim_idle(&sim))
+				sim.tick = input->tick;
+			else
+				sim_tick(&sim);
+		}
+
+		switch (input->action) {
+		case SIM_COMMAND_SEEK:
+			sim_seek(&sim, input->player, input->arg);
+		break;
+		case SIM_COMMAND_BRANCH:
+			sim_branch(&sim, input->player);
+		break;
+		default:
+			events = sim_act(&sim, input->player, input->action);
+			if (events & (SIM_EVENT_SLIDE | SIM_EVENT_SWIPE | SIM_EVENT_UNDO))
+				++*num_moves;
+			if (events & SIM_EVENT_RESET)
+				level_restart(level, players, map_pack_get(pack, run->level_idx));
+		break;
+		}
+	}
+
+	while (!sim_idle(&sim))
+		sim_tick(&sim);
+}
+
+int main(int argc, char *const argv[])
+{
+	array(struct replay_run) runs;
+	struct map_pack pack = { 0 };
+	const char *maps_file_name = NULL;
+	struct level level = { 0 };
+	struct player players[PLAYER_CNT_MAX] = { 0 };
+	const char *fname = NULL;
+	int repeat = 1;
+	u32 num_moves = 0;
+	b32 detail = false;
+	clock_t start;
+	r64 seconds;
+	int ret = 0;
+
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "-v") == 0)
+			detail = true;
+		else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc)
+			repeat = atoi(argv[++i]);
+		else
+			fname = argv[i];
+	}
+
+	if (!fname || repeat < 1) {
+		fprintf(stderr, "usage: %s [-v] [--repeat N] <session.replay>\n", argv[0]);
+		return 1;
+	}
+
+	runs = array_create();
+	if (!load_replay(fname, &runs)) {
+		fprintf(stderr, "failed to load replay\n");
+		array_destroy(runs);
+		return 1;
+	}
+
+	start = clock();
+	for (int r = 0; r < repeat; ++r) {
+		array_foreach(runs, const struct replay_run, run) {
+			if (!maps_file_name || strcmp(maps_file_name, run->maps_file_name) != 0) {
+				maps_file_name = run->maps_file_name;
+				if (!map_pack_open(&pack, maps_file_name)) {
+					fprintf(stderr, "failed to load maps from '%s'\n", maps_file_name);
+					ret = 1;
+					goto out;
+				}
+			}
+			if (run->level_idx >= map_pack_sz(&pack)) {
+				fprintf(stderr, "level %u not in '%s'\n", run->level_idx + 1, maps_file_name);
+				ret = 1;
+				goto out;
+			}
+
+			replay__run(run, &pack, &level, players, &num_moves);
+
+			if (detail && r == 0)
+				printf("%s level %u: %u inputs, %s\n", run->maps_file_name,
+				       run->level_idx + 1, array_sz(run->inputs),
+				       level_complete(&level) ? "complete" : "incomplete");
+		}
+	}
+	seconds = (r64)(clock() - start) / CLOCKS_PER_SEC;
+
+	printf("%u runs x %d: %u moves in %.3f s", array_sz(runs), repeat, num_moves, seconds);
+	if (seconds > 0)
+		printf(", %.0f moves/s", num_moves / seconds);
+	printf("\n");
+
+out:
+	for (u32 i = 0; i < PLAYER_CNT_MAX; ++i)
+		player_destroy(&players[i]);
+	level_destroy(&level);
+	map_pack_close(&pack);
+	replay_clear(&runs);
+	array_destroy(runs);
+	return ret;
+}
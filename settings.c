@@ -1,3 +1,11 @@
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include <SDL.h>
 #include "config.h"
 #include "violet/all.h"
 #include "key.h"
@@ -5,7 +13,7 @@
 #include "action.h"
 #include "settings.h"
 
-gui_key_t g_key_bindings[PLAYER_CNT_MAX][ACTION_COUNT] = {
+gui_key_t g_key_bindings[PLAYER_CNT_LOCAL][ACTION_COUNT] = {
 	{
 		KB_W,
 		KB_S,
@@ -15,6 +23,7 @@ gui_key_t g_key_bindings[PLAYER_CNT_MAX][ACTION_COUNT] = {
 		KB_Q,
 		KB_Z,
 		KB_C,
+		KB_X,
 	},
 	{
 		KB_KP_8,
@@ -25,13 +34,41 @@ gui_key_t g_key_bindings[PLAYER_CNT_MAX][ACTION_COUNT] = {
 		KB_KP_7,
 		KB_KP_1,
 		KB_KP_2,
+		KB_KP_3,
 	},
 };
 
 const char *g_settings_path = "prefs.vson";
+const char *g_settings_tmp_path = "prefs.vson.tmp";
 u32         g_player_to_bind = ~0;
 enum action g_action_to_bind = ACTION_COUNT;
 
+/*
+ * save_settings() only copies the settings into g_pending.  A writer thread
+ * waits for changes to stop for SETTINGS_SAVE_DELAY_MILLI, then writes the
+ * latest copy to a temporary file and renames it over the old one, so the
+ * frame never touches the disk and a crash leaves either file intact.
+ * The file is synced before the rename, and the directory after it, so
+ * a power loss can't leave the rename on disk without the data.
+ * Emscripten has no threads, but its files live in memory anyway.
+ */
+struct settings__state
+{
+	gui_key_t key_bindings[PLAYER_CNT_LOCAL][ACTION_COUNT];
+	b32 music_enabled;
+	b32 sound_enabled;
+};
+
+#ifndef __EMSCRIPTEN__
+static SDL_Thread *g_writer = NULL;
+static SDL_mutex *g_writer_mutex = NULL;
+static SDL_cond *g_writer_cond = NULL;
+static struct settings__state g_pending;
+static b32 g_pending_dirty = false;
+static u32 g_pending_ticks;
+static b32 g_writer_quit = false;
+#endif
+
 void load_settings(void)
 {
 	FILE *fp;
@@ -47,7 +84,8 @@ void load_settings(void)
 		return;
 	}
 
-	if (!vson_read_u32(fp, "players", &num_players_saved))
+	if (   !vson_read_u32(fp, "players", &num_players_saved)
+	    || num_players_saved > PLAYER_CNT_MAX)
 		goto out;
 	if (!vson_read_u32(fp, "actions", &num_actions_saved))
 		goto out;
@@ -55,11 +93,14 @@ void load_settings(void)
 		for (u32 j = 0; j < num_actions_saved; ++j) {
 			if (!vson_read_str(fp, "action", buf, 64))
 				goto out;
-			if (!(vson_read_u32(fp, "key", &key) && is_key(key)))
+			if (!vson_read_u32(fp, "key", &key))
 				goto out;
+			/* older files saved unbound keys for players past these */
+			if (i >= PLAYER_CNT_LOCAL || !is_key(key))
+				continue;
 			for (u32 k = 0; k < ACTION_COUNT; ++k) {
 				if (strncmp(action_to_string(k), buf, 64) == 0) {
-					g_key_bindings[i][j] = key;
+					g_key_bindings[i][k] = key;
 					break;
 				}
 			}
@@ -88,35 +129,189 @@ out:
 	fclose(fp);
 }
 
-void save_settings(void)
+static
+b32 settings__sync(FILE *fp)
+{
+	if (fflush(fp) != 0)
+		return false;
+#ifdef _WIN32
+	return _commit(_fileno(fp)) == 0;
+#else
+	return fsync(fileno(fp)) == 0;
+#endif
+}
+
+static
+void settings__sync_dir(const char *path)
+{
+#ifndef _WIN32
+	char dir[256] = ".";
+	const char *slash = strrchr(path, '/');
+	int fd;
+
+	if (slash == path) {
+		strcpy(dir, "/");
+	} else if (slash && (size_t)(slash - path) < sizeof(dir)) {
+		memcpy(dir, path, slash - path);
+		dir[slash - path] = '\0';
+	}
+	fd = open(dir, O_RDONLY);
+	if (fd < 0)
+		return;
+	fsync(fd);
+	close(fd);
+#endif
+}
+
+static
+void settings__write(const struct settings__state *state)
 {
 	FILE *fp;
+	b32 synced;
 
-	fp = fopen(g_settings_path, "w");
+	fp = fopen(g_settings_tmp_path, "w");
 	if (!fp) {
 		log_error("Cannot create settings file");
 		return;
 	}
 
-	vson_write_u32(fp, "players", PLAYER_CNT_MAX);
+	vson_write_u32(fp, "players", PLAYER_CNT_LOCAL);
 	vson_write_u32(fp, "actions", ACTION_COUNT);
-	for (u32 i = 0; i < PLAYER_CNT_MAX; ++i) {
+	for (u32 i = 0; i < PLAYER_CNT_LOCAL; ++i) {
 		for (u32 j = 0; j < ACTION_COUNT; ++j) {
 			vson_write_str(fp, "action", action_to_string(j));
-			vson_write_u32(fp, "key", g_key_bindings[i][j]);
+			vson_write_u32(fp, "key", state->key_bindings[i][j]);
 		}
 	}
 
-	vson_write_b32(fp, "music_enabled", music_enabled());
-	vson_write_b32(fp, "sound_enabled", sound_enabled());
+	vson_write_b32(fp, "music_enabled", state->music_enabled);
+	vson_write_b32(fp, "sound_enabled", state->sound_enabled);
 
-	fclose(fp);
+	synced = settings__sync(fp);
+	if (fclose(fp) != 0 || !synced) {
+		log_error("Cannot write settings file");
+		remove(g_settings_tmp_path);
+		return;
+	}
+
+#ifdef _WIN32
+	/* rename() refuses to replace an existing file on Windows */
+	if (!MoveFileExA(g_settings_tmp_path, g_settings_path,
+	                 MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+#else
+	if (rename(g_settings_tmp_path, g_settings_path) != 0)
+#endif
+		log_error("Cannot replace settings file");
+	else
+		settings__sync_dir(g_settings_path);
+}
+
+#ifndef __EMSCRIPTEN__
+static
+int settings__writer(void *udata)
+{
+	struct settings__state state;
+
+	SDL_LockMutex(g_writer_mutex);
+	for (;;) {
+		while (!g_pending_dirty && !g_writer_quit)
+			SDL_CondWait(g_writer_cond, g_writer_mutex);
+		if (!g_pending_dirty)
+			break;
+
+		/* restart the wait on every change; quitting flushes right away */
+		while (!g_writer_quit) {
+			const u32 elapsed = SDL_GetTicks() - g_pending_ticks;
+			if (elapsed >= SETTINGS_SAVE_DELAY_MILLI)
+				break;
+			SDL_CondWaitTimeout(g_writer_cond, g_writer_mutex,
+			                    SETTINGS_SAVE_DELAY_MILLI - elapsed);
+		}
+
+		state = g_pending;
+		g_pending_dirty = false;
+		SDL_UnlockMutex(g_writer_mutex);
+		settings__write(&state);
+		SDL_LockMutex(g_writer_mutex);
+	}
+	SDL_UnlockMutex(g_writer_mutex);
+	return 0;
+}
+
+static
+b32 settings__writer_start(void)
+{
+	g_writer_mutex = SDL_CreateMutex();
+	g_writer_cond = SDL_CreateCond();
+	if (!g_writer_mutex || !g_writer_cond)
+		goto err;
+	g_writer_quit = false;
+	g_writer = SDL_CreateThread(settings__writer, "settings", NULL);
+	if (!g_writer)
+		goto err;
+	return true;
+
+err:
+	log_error("Unable to start settings writer: %s", SDL_GetError());
+	if (g_writer_cond)
+		SDL_DestroyCond(g_writer_cond);
+	if (g_writer_mutex)
+		SDL_DestroyMutex(g_writer_mutex);
+	g_writer_cond = NULL;
+	g_writer_mutex = NULL;
+	return false;
+}
+#endif
+
+void save_settings(void)
+{
+	struct settings__state state;
+
+	memcpy(state.key_bindings, g_key_bindings, sizeof(state.key_bindings));
+	state.music_enabled = music_enabled();
+	state.sound_enabled = sound_enabled();
+
+#ifndef __EMSCRIPTEN__
+	if (!g_writer && !settings__writer_start()) {
+		settings__write(&state);
+		return;
+	}
+
+	SDL_LockMutex(g_writer_mutex);
+	g_pending = state;
+	g_pending_dirty = true;
+	g_pending_ticks = SDL_GetTicks();
+	SDL_CondSignal(g_writer_cond);
+	SDL_UnlockMutex(g_writer_mutex);
+#else
+	settings__write(&state);
+#endif
+}
+
+void flush_settings(void)
+{
+#ifndef __EMSCRIPTEN__
+	if (!g_writer)
+		return;
+
+	SDL_LockMutex(g_writer_mutex);
+	g_writer_quit = true;
+	SDL_CondSignal(g_writer_cond);
+	SDL_UnlockMutex(g_writer_mutex);
+	SDL_WaitThread(g_writer, NULL);
+	g_writer = NULL;
+
+	SDL_DestroyCond(g_writer_cond);
+	SDL_DestroyMutex(g_writer_mutex);
+	g_writer_cond = NULL;
+	g_writer_mutex = NULL;
+#endif
 }
 
 static
 b32 is_key_bound_excluding(gui_key_t key, u32 player_excluded, u32 action_excluded)
 {
-	for (u32 i = 0; i < PLAYER_CNT_MAX; ++i)
+	for (u32 i = 0; i < PLAYER_CNT_LOCAL; ++i)
 		for (u32 j = 0; j < ACTION_COUNT; ++j)
 			if (   i != player_excluded
 			    && j != action_excluded
@@ -135,7 +330,7 @@ void show_settings(gui_t *gui, gui_panel_t *panel)
 	static const r32 cells_key[] = { GUI_GRID_REMAINING, GUI_GRID_REMAINING };
 	char buf[32];
 	pgui_panel(gui, panel);
-	for (u32 i = 0; i < PLAYER_CNT_MAX; ++i) {
+	for (u32 i = 0; i < PLAYER_CNT_LOCAL; ++i) {
 		for (u32 j = 0; j < ACTION_COUNT; ++j) {
 			pgui_row_cellsv(gui, 20, cells_key);
 			sprintf(buf, "Player %u ", i + 1);
@@ -2,10 +2,12 @@
  * Key bindings & audio settings
  */
 
-gui_key_t g_key_bindings[PLAYER_CNT_MAX][ACTION_COUNT];
+/* Only the players the menu can start have keys */
+gui_key_t g_key_bindings[PLAYER_CNT_LOCAL][ACTION_COUNT];
 
 void load_settings(void);
 void save_settings(void);
+void flush_settings(void);
 
 b32 is_key_bound(gui_key_t key);
 
@@ -0,0 +1,464 @@
+#include "config.h"
+#include "core.h"
+#include "action.h"
+#include "types.h"
+#include "constants.h"
+#include "actor.h"
+#include "history.h"
+#include "level.h"
+#include "sim.h"
+
+/*
+ * The game rules, stepped in fixed ticks.  Nothing here draws or plays
+ * sounds; what happened is reported as SIM_EVENT_* bits instead, so the
+ * same code runs the game and replays recorded sessions.
+ */
+
+static
+v2i sim__perp(v2i v, enum action action)
+{
+	switch (action) {
+	case ACTION_ROTATE_CCW:
+		return v2i_lperp(v);
+	break;
+	case ACTION_ROTATE_CW:
+		return v2i_rperp(v);
+	break;
+	case ACTION_MOVE_UP:
+	case ACTION_MOVE_DOWN:
+	case ACTION_MOVE_LEFT:
+	case ACTION_MOVE_RIGHT:
+	case ACTION_UNDO:
+	case ACTION_RESET:
+	case ACTION_REDO:
+	case ACTION_COUNT:
+	break;
+	}
+	assert(false);
+	return v;
+}
+
+/* The action the redo tail starts with, if there is one */
+static
+b32 sim__redo_action(const struct player *player, enum action *action)
+{
+	u32 cursor = history_end(&player->history);
+	u32 num_clones;
+	return history_next(&player->history, &cursor, action, &num_clones);
+}
+
+static
+b32 sim__can_execute_solo_action(enum action action, const struct player *player,
+                                 const struct level *level)
+{
+	if (action == ACTION_UNDO) {
+		u32 cursor = history_end(&player->history);
+		enum action a;
+		u32 num_clones;
+
+		for (u32 i = 0; i < player->num_actors; ++i) {
+			const struct actor *actor = player->actors[player->num_actors - i - 1];
+			if (!history_prev(&player->history, &cursor, &a, &num_clones))
+				return false;
+			if (!actor_can_undo(actor, level, a, num_clones))
+				return false;
+		}
+		return true;
+	} else if (action == ACTION_REDO) {
+		enum action next;
+		return    sim__redo_action(player, &next)
+		       && sim__can_execute_solo_action(next, player, level);
+	} else {
+		for (u32 j = 0; j < player->num_actors; ++j)
+			if (!actor_can_act(player->actors[j], level, action))
+				return false;
+	}
+	return true;
+}
+
+/* Turns the clones actor idx carries, each relative to the actor */
+static
+void sim__rotate(struct level *level, u32 idx, enum action action)
+{
+	for (u32 i = 0; i < level->num_clones; ++i)
+		if (level->clone_owner[i] == idx)
+			level->clone_pos[i] = sim__perp(level->clone_pos[i], action);
+}
+
+static
+void sim__undo(struct player *player, struct level *level)
+{
+	for (u32 i = 0; i < player->num_actors; ++i) {
+		struct actor *actor = player->actors[player->num_actors - i - 1];
+		const u32 idx = actor - level->actors;
+		enum action action;
+		u32 num_clones;
+		if (history_pop(&player->history, &action, &num_clones)) {
+			/* the last clones picked up are let go where they stand */
+			actor->num_clones -= num_clones;
+			for (u32 j = 0; j < level->num_clones; ++j) {
+				if (   level->clone_owner[j] == idx
+				    && level->clone_order[j] >= actor->num_clones) {
+					level->clone_pos[j] = level_clone_tile(level, j);
+					level->clone_owner[j] = ACTOR_NONE;
+					++level->num_free_clones;
+				}
+			}
+			switch (action) {
+			case ACTION_MOVE_UP:
+				--actor->tile.y;
+				actor->pos.y = actor->tile.y * SUBTILE_DIM;
+			break;
+			case ACTION_MOVE_DOWN:
+				++actor->tile.y;
+				actor->pos.y = actor->tile.y * SUBTILE_DIM;
+			break;
+			case ACTION_MOVE_LEFT:
+				++actor->tile.x;
+				actor->pos.x = actor->tile.x * SUBTILE_DIM;
+			break;
+			case ACTION_MOVE_RIGHT:
+				--actor->tile.x;
+				actor->pos.x = actor->tile.x * SUBTILE_DIM;
+			break;
+			case ACTION_ROTATE_CW:
+				sim__rotate(level, idx, ACTION_ROTATE_CCW);
+			break;
+			case ACTION_ROTATE_CCW:
+				sim__rotate(level, idx, ACTION_ROTATE_CW);
+			break;
+			case ACTION_UNDO:
+			case ACTION_RESET:
+			case ACTION_REDO:
+			case ACTION_COUNT:
+				assert(false);
+			break;
+			}
+			actor->prev_pos = actor->pos;
+		}
+	}
+	level_update_occupancy(level);
+}
+
+/* Steps over the redo tail when it already holds this event */
+static
+void sim__record(struct history *history, enum action action, u32 num_clones)
+{
+	u32 cursor = history_end(history);
+	enum action a;
+	u32 n;
+	if (   history_next(history, &cursor, &a, &n)
+	    && a == action && n == num_clones)
+		history_redo(history, &a, &n);
+	else
+		history_push(history, action, num_clones);
+}
+
+static
+u32 sim__execute_action(struct sim *sim, enum action action, struct player *player)
+{
+	struct level *level = sim->level;
+	enum dir dir;
+	struct actor *actor;
+	u32 num_clones_attached;
+
+	switch (action) {
+	case ACTION_MOVE_UP:
+	case ACTION_MOVE_DOWN:
+	case ACTION_MOVE_LEFT:
+	case ACTION_MOVE_RIGHT:
+		dir = g_action_dir[action];
+		for (u32 i = 0; i < player->num_actors; ++i) {
+			actor = player->actors[i];
+			actor->facing = dir;
+			actor->dir = dir;
+			v2i_add_eq(&actor->tile, g_dir_vec[dir]);
+		}
+		level_update_occupancy(level);
+		return SIM_EVENT_SLIDE;
+	case ACTION_ROTATE_CCW:
+	case ACTION_ROTATE_CW:
+		for (u32 i = 0; i < player->num_actors; ++i) {
+			actor = player->actors[i];
+			sim__rotate(level, actor - level->actors, action);
+			actor_entered_tile(actor, level, &num_clones_attached);
+			sim__record(&player->history, action, num_clones_attached);
+		}
+		return SIM_EVENT_SWIPE;
+	case ACTION_UNDO:
+		sim__undo(player, level);
+		for (u32 i = 0; i < sim->num_players; ++i) {
+			for (u32 j = 0; j < sim->players[i].num_actors; ++j) {
+				struct history *history = &sim->players[i].history;
+				actor_entered_tile(sim->players[i].actors[j], level, &num_clones_attached);
+				if (num_clones_attached) {
+					u32 cursor = history_end(history);
+					enum action a;
+					u32 num_clones;
+					if (history_prev(history, &cursor, &a, &num_clones))
+						history_amend(history, num_clones_attached + num_clones);
+				}
+			}
+		}
+		return SIM_EVENT_UNDO;
+	case ACTION_REDO: {
+		enum action next;
+		if (!sim__redo_action(player, &next))
+			return 0;
+		return sim__execute_action(sim, next, player);
+	}
+	case ACTION_RESET:
+		/* the attempt so far stays redoable from the start */
+		for (u32 i = 0; i < sim->num_players; ++i)
+			history_rewind(&sim->players[i].history);
+		return SIM_EVENT_RESET;
+	case ACTION_COUNT:
+		assert(false);
+	}
+	return 0;
+}
+
+static
+b32 sim__all_other_players_pending_action(const struct sim *sim, u32 excluded_player,
+                                          enum action action)
+{
+	for (u32 i = 0; i < sim->num_players; ++i)
+		if (i != excluded_player && sim->players[i].pending_action != action)
+			return false;
+	return true;
+}
+
+/* Ends a walk early, as if the actor had arrived this tick */
+static
+void sim__arrive(struct sim *sim, struct actor *actor)
+{
+	struct player *player = &sim->players[actor->player];
+	u32 num_clones_attached;
+
+	actor_entered_tile(actor, sim->level, &num_clones_attached);
+	sim__record(&player->history, g_dir_action[actor->dir], num_clones_attached);
+	actor->pos = v2i_scale(actor->tile, SUBTILE_DIM);
+	actor->dir = DIR_NONE;
+}
+
+/* Snapshots capture the whole level, which is only safe to jump back to
+ * when one player's history accounts for every change. */
+static
+void sim__snapshot(struct sim *sim)
+{
+	const struct level *level = sim->level;
+	struct history *history = &sim->players[0].history;
+	struct sim_snapshot *snapshot;
+	const u32 n = level->num_clones;
+	u32 sz;
+	u8 *p;
+
+	if (   sim->num_players != 1
+	    || !sim_idle(sim)
+	    || !history_snapshot_due(history))
+		return;
+
+	sz = sizeof(*snapshot) + n * (sizeof(v2i) + 2 * sizeof(u32));
+	snapshot = malloc(sz);
+	memcpy(snapshot->actors, level->actors, sizeof(snapshot->actors));
+	snapshot->num_actors = level->num_actors;
+	snapshot->num_clones = n;
+	p = (u8*)(snapshot + 1);
+	memcpy(p, level->clone_pos, n * sizeof(v2i));
+	p += n * sizeof(v2i);
+	memcpy(p, level->clone_owner, n * sizeof(u32));
+	p += n * sizeof(u32);
+	memcpy(p, level->clone_order, n * sizeof(u32));
+	history_snapshot(history, snapshot, sz);
+	free(snapshot);
+}
+
+static
+void sim__restore(struct sim *sim, const struct sim_snapshot *snapshot)
+{
+	struct level *level = sim->level;
+	const u32 n = snapshot->num_clones;
+	const u8 *p = (const u8*)(snapshot + 1);
+
+	/* the pool's size & required flags are fixed for the level */
+	assert(n == level->num_clones);
+	memcpy(level->actors, snapshot->actors, sizeof(level->actors));
+	level->num_actors = snapshot->num_actors;
+	memcpy(level->clone_pos, p, n * sizeof(v2i));
+	p += n * sizeof(v2i);
+	memcpy(level->clone_owner, p, n * sizeof(u32));
+	p += n * sizeof(u32);
+	memcpy(level->clone_order, p, n * sizeof(u32));
+	level->num_free_clones = 0;
+	for (u32 i = 0; i < n; ++i)
+		level->num_free_clones += level->clone_owner[i] == ACTOR_NONE;
+	for (u32 i = 0; i < level->num_actors; ++i)
+		level->actors[i].prev_pos = level->actors[i].pos;
+	level_update_occupancy(level);
+}
+
+static
+void sim__log(struct sim *sim, u32 idx, u32 action, u32 arg)
+{
+	if (sim->log) {
+		const struct sim_input input = {
+			.tick = sim->tick,
+			.player = idx,
+			.action = action,
+			.arg = arg,
+		};
+		array_append(*sim->log, input);
+	}
+}
+
+static
+b32 sim__player_idle(const struct player *player)
+{
+	for (u32 i = 0; i < player->num_actors; ++i)
+		if (player->actors[i]->dir != DIR_NONE)
+			return false;
+	return true;
+}
+
+void sim_init(struct sim *sim, struct level *level, struct player players[],
+              u32 num_players)
+{
+	sim->level = level;
+	sim->players = players;
+	sim->num_players = num_players;
+	sim->tick = 0;
+	sim->log = NULL;
+}
+
+u32 sim_act(struct sim *sim, u32 idx, enum action action)
+{
+	struct player *player = &sim->players[idx];
+	u32 events = 0;
+
+	sim__log(sim, idx, action, 0);
+
+	if (action_is_solo(action)) {
+		if (sim__can_execute_solo_action(action, player, sim->level)) {
+			events = sim__execute_action(sim, action, player);
+		} else {
+			if (action_is_move(action))
+				for (u32 j = 0; j < player->num_actors; ++j)
+					player->actors[j]->facing = g_action_dir[action];
+			events = SIM_EVENT_BLOCKED;
+		}
+	} else if (sim->num_players == 1) {
+		events = sim__execute_action(sim, action, player);
+	} else if (sim__all_other_players_pending_action(sim, idx, action)) {
+		events = sim__execute_action(sim, action, player);
+		for (u32 j = 0; j < sim->num_players; ++j)
+			sim->players[j].pending_action = ACTION_COUNT;
+	} else if (player->pending_action == action) {
+		player->pending_action = ACTION_COUNT;
+	} else {
+		player->pending_action = action;
+	}
+	sim__snapshot(sim);
+	return events;
+}
+
+void sim_tick(struct sim *sim)
+{
+	struct level *level = sim->level;
+
+	for (u32 i = 0; i < level->num_actors; ++i) {
+		struct actor *actor = &level->actors[i];
+		const v2i dst = v2i_scale(actor->tile, SUBTILE_DIM);
+		const v2i dir = g_dir_vec[actor->dir];
+		v2i pos;
+
+		actor->prev_pos = actor->pos;
+		if (actor->dir == DIR_NONE)
+			continue;
+
+		pos = v2i_add(actor->pos, v2i_scale(dir, WALK_STEP));
+		if ((dst.x - pos.x) * dir.x + (dst.y - pos.y) * dir.y <= 0) {
+			sim__arrive(sim, actor);
+		} else {
+			actor->pos = pos;
+			actor->anim_milli += SIM_TICK_MILLI;
+		}
+	}
+	++sim->tick;
+	sim__snapshot(sim);
+}
+
+b32 sim_idle(const struct sim *sim)
+{
+	for (u32 i = 0; i < sim->level->num_actors; ++i)
+		if (sim->level->actors[i].dir != DIR_NONE)
+			return false;
+	return true;
+}
+
+u32 sim_num_moves(const struct sim *sim, u32 idx)
+{
+	const struct player *player = &sim->players[idx];
+	return player->num_actors ? history_sz(&player->history) / player->num_actors : 0;
+}
+
+/* Including those that can be redone */
+u32 sim_num_moves_max(const struct sim *sim, u32 idx)
+{
+	const struct player *player = &sim->players[idx];
+	return player->num_actors ? history_len(&player->history) / player->num_actors : 0;
+}
+
+/* Undoes or redoes player idx's moves until it has made num_moves, without
+ * walking.  Returns false if something in the way stopped it short. */
+b32 sim_seek(struct sim *sim, u32 idx, u32 num_moves)
+{
+	struct player *player = &sim->players[idx];
+	struct history *history = &player->history;
+	const u32 target = num_moves * player->num_actors;
+	const u32 present = history_sz(history);
+	const struct history_snapshot *snapshot = NULL;
+	enum action action;
+
+	sim__log(sim, idx, SIM_COMMAND_SEEK, num_moves);
+
+	if (!sim__player_idle(player))
+		return false;
+
+	if (sim->num_players == 1)
+		snapshot = history_find_snapshot(history, target);
+	if (   snapshot
+	    && target - snapshot->num_events < (present > target ? present - target : target - present)) {
+		sim__restore(sim, history_restore_snapshot(history, snapshot));
+	}
+
+	while (history_sz(history) > target) {
+		if (!sim__can_execute_solo_action(ACTION_UNDO, player, sim->level))
+			return false;
+		sim__execute_action(sim, ACTION_UNDO, player);
+	}
+
+	while (history_sz(history) < target && sim__redo_action(player, &action)) {
+		if (!sim__can_execute_solo_action(action, player, sim->level))
+			return false;
+		sim__execute_action(sim, action, player);
+		for (u32 i = 0; i < player->num_actors; ++i) {
+			struct actor *actor = player->actors[i];
+			if (actor->dir != DIR_NONE)
+				sim__arrive(sim, actor);
+			actor->prev_pos = actor->pos;
+		}
+		sim__snapshot(sim);
+	}
+
+	return history_sz(history) == target;
+}
+
+/* Swaps what player idx would redo for another line tried from here */
+b32 sim_branch(struct sim *sim, u32 idx)
+{
+	struct player *player = &sim->players[idx];
+
+	sim__log(sim, idx, SIM_COMMAND_BRANCH, 0);
+
+	return sim__player_idle(player) && history_switch_branch(&player->history);
+}
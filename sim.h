@@ -0,0 +1,9 @@
+void sim_init(struct sim *sim, struct level *level, struct player players[],
+              u32 num_players);
+u32  sim_act(struct sim *sim, u32 idx, enum action action);
+void sim_tick(struct sim *sim);
+b32  sim_idle(const struct sim *sim);
+u32  sim_num_moves(const struct sim *sim, u32 idx);
+u32  sim_num_moves_max(const struct sim *sim, u32 idx);
+b32  sim_seek(struct sim *sim, u32 idx, u32 num_moves);
+b32  sim_branch(struct sim *sim, u32 idx);
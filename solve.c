@@ -0,0 +1,378 @@
+#include "config.h"
+#include "core.h"
+#include "action.h"
+#include "types.h"
+#include "constants.h"
+#include "actor.h"
+#include "player.h"
+#include "level.h"
+#include "solve.h"
+
+/*
+ * Breadth-first search over the positions of a level, every actor taking
+ * each move together as in single-player.  A position is packed into a
+ * key of u32s:
+ *   mask of the pool's clones still free, a bit per clone
+ *   per actor: tile, number of clones attached, the clones sorted
+ * Free clones never move, so their slot says where they are; attached ones
+ * are sorted so it doesn't matter which slot they came from.  Nodes live
+ * in the order found, so the node array doubles as the queue, and the
+ * level is rebuilt from a node's key rather than undone.
+ */
+
+#define SOLVE__PATHS_MAX (~0u)
+
+static
+u32 solve__pack_tile(v2i tile)
+{
+	return ((u32)(tile.y + MAP_DIM_MAX) << 16) | (u32)(tile.x + MAP_DIM_MAX);
+}
+
+static
+v2i solve__unpack_tile(u32 packed)
+{
+	return (v2i){
+		.x = (s32)(packed & 0xffff) - MAP_DIM_MAX,
+		.y = (s32)(packed >> 16) - MAP_DIM_MAX,
+	};
+}
+
+/* Relative positions are within +-MAP_DIM_MAX, leaving the low bit free */
+static
+u32 solve__pack_clone(const struct level *level, u32 clone)
+{
+	return solve__pack_tile(level->clone_pos[clone]) << 1 | (level->clone_required[clone] != 0);
+}
+
+static
+u32 solve__mask_len(const struct level *level)
+{
+	return (level->num_clones + 31) / 32;
+}
+
+static
+u32 solve__hash(const u32 *key, u32 len)
+{
+	u32 hash = 2166136261u;
+	for (u32 i = 0; i < len; ++i) {
+		hash ^= key[i];
+		hash *= 16777619u;
+	}
+	return hash ^ (hash >> 15);
+}
+
+static
+void solve__pos_sort(u32 *v, u32 n)
+{
+	for (u32 i = 1; i < n; ++i) {
+		const u32 x = v[i];
+		u32 j = i;
+		for (; j > 0 && v[j-1] > x; --j)
+			v[j] = v[j-1];
+		v[j] = x;
+	}
+}
+
+/* Appends the level's position to solver.keys, returning its length */
+static
+u32 solve__encode(struct solver *solver)
+{
+	const struct level *level = &solver->level;
+	const u32 mask_len = solve__mask_len(level);
+	u32 len = mask_len;
+	u32 *mask;
+
+	for (u32 i = 0; i < mask_len; ++i)
+		array_append(solver->keys, 0);
+	mask = &solver->keys[array_sz(solver->keys) - mask_len];
+	for (u32 i = 0; i < level->num_clones; ++i)
+		if (level->clone_owner[i] == ACTOR_NONE)
+			mask[i / 32] |= 1u << (i % 32);
+
+	for (u32 i = 0; i < level->num_actors; ++i) {
+		const struct actor *actor = &level->actors[i];
+		u32 *clones;
+		array_append(solver->keys, solve__pack_tile(actor->tile));
+		array_append(solver->keys, actor->num_clones);
+		for (u32 j = 0; j < level->num_clones; ++j)
+			if (level->clone_owner[j] == i)
+				array_append(solver->keys, solve__pack_clone(level, j));
+		clones = &solver->keys[array_sz(solver->keys) - actor->num_clones];
+		solve__pos_sort(clones, actor->num_clones);
+		len += 2 + actor->num_clones;
+	}
+	return len;
+}
+
+/* Free clones go back to their own slots, attached ones fill the rest */
+static
+void solve__decode(struct solver *solver, const struct solve_node *node)
+{
+	struct level *level = &solver->level;
+	const u32 *mask = &solver->keys[node->key];
+	const u32 *key = mask + solve__mask_len(level);
+	u32 slot = 0;
+
+	level->num_free_clones = 0;
+	for (u32 i = 0; i < level->num_clones; ++i) {
+		if (mask[i / 32] & (1u << (i % 32))) {
+			++level->num_free_clones;
+			level->clone_pos[i] = solver->clone_pos[i];
+			level->clone_required[i] = solver->clone_required[i];
+			level->clone_owner[i] = ACTOR_NONE;
+		}
+	}
+
+	for (u32 i = 0; i < level->num_actors; ++i) {
+		struct actor *actor = &level->actors[i];
+		*actor = solver->actors[i];
+		actor->tile = solve__unpack_tile(*key++);
+		actor->num_clones = *key++;
+		for (u32 j = 0; j < actor->num_clones; ++j, ++key) {
+			while (mask[slot / 32] & (1u << (slot % 32)))
+				++slot;
+			level->clone_pos[slot] = solve__unpack_tile(*key >> 1);
+			level->clone_required[slot] = *key & 1;
+			level->clone_owner[slot] = i;
+			level->clone_order[slot] = j;
+			++slot;
+		}
+	}
+	level_update_occupancy(level);
+}
+
+static
+b32 solve__key_eq(const struct solver *solver, u32 idx, u32 key, u32 len)
+{
+	const struct solve_node *node = &solver->nodes[idx];
+	return    node->key_len == len
+	       && memcmp(&solver->keys[node->key], &solver->keys[key], len * sizeof(u32)) == 0;
+}
+
+static
+void solve__table_grow(struct solver *solver)
+{
+	const u32 table_sz = max(solver->table_sz * 2, 1024);
+	u32 *table = calloc(table_sz, sizeof(u32));
+
+	for (u32 i = 0; i < solver->table_sz; ++i) {
+		if (solver->table[i]) {
+			const struct solve_node *node = &solver->nodes[solver->table[i] - 1];
+			u32 slot = solve__hash(&solver->keys[node->key], node->key_len) & (table_sz - 1);
+			while (table[slot])
+				slot = (slot + 1) & (table_sz - 1);
+			table[slot] = solver->table[i];
+		}
+	}
+	free(solver->table);
+	solver->table = table;
+	solver->table_sz = table_sz;
+}
+
+/* The node with the key at the end of solver.keys, or a new one for it */
+static
+u32 solve__intern(struct solver *solver, u32 len, b32 *found)
+{
+	const u32 key = array_sz(solver->keys) - len;
+	u32 slot;
+
+	if ((array_sz(solver->nodes) + 1) * 2 > solver->table_sz)
+		solve__table_grow(solver);
+
+	slot = solve__hash(&solver->keys[key], len) & (solver->table_sz - 1);
+	while (solver->table[slot]) {
+		const u32 idx = solver->table[slot] - 1;
+		if (solve__key_eq(solver, idx, key, len)) {
+			array_sz(solver->keys) = key; /* not needed twice */
+			*found = true;
+			return idx;
+		}
+		slot = (slot + 1) & (solver->table_sz - 1);
+	}
+
+	{
+		const struct solve_node node = { .key = key, .key_len = len };
+		array_append(solver->nodes, node);
+	}
+	solver->table[slot] = array_sz(solver->nodes);
+	*found = false;
+	return array_sz(solver->nodes) - 1;
+}
+
+static
+void solve__apply(struct level *level, enum action action)
+{
+	switch (action) {
+	case ACTION_MOVE_UP:
+	case ACTION_MOVE_DOWN:
+	case ACTION_MOVE_LEFT:
+	case ACTION_MOVE_RIGHT:
+		for (u32 i = 0; i < level->num_actors; ++i) {
+			struct actor *actor = &level->actors[i];
+			v2i_add_eq(&actor->tile, g_dir_vec[g_action_dir[action]]);
+			actor_entered_tile(actor, level, NULL);
+		}
+	break;
+	case ACTION_ROTATE_CCW:
+	case ACTION_ROTATE_CW:
+		for (u32 i = 0; i < level->num_clones; ++i)
+			if (level->clone_owner[i] != ACTOR_NONE)
+				level->clone_pos[i] = action == ACTION_ROTATE_CW
+				                    ? v2i_rperp(level->clone_pos[i])
+				                    : v2i_lperp(level->clone_pos[i]);
+		for (u32 i = 0; i < level->num_actors; ++i)
+			actor_entered_tile(&level->actors[i], level, NULL);
+	break;
+	case ACTION_UNDO:
+	case ACTION_RESET:
+	case ACTION_REDO:
+	case ACTION_COUNT:
+		assert(false);
+	break;
+	}
+}
+
+void solver_init(struct solver *solver)
+{
+	memset(solver, 0, sizeof(*solver));
+	solver->nodes = array_create();
+	solver->keys = array_create();
+	solver->clone_pos = array_create();
+	solver->clone_required = array_create();
+}
+
+void solver_destroy(struct solver *solver)
+{
+	array_destroy(solver->nodes);
+	array_destroy(solver->keys);
+	array_destroy(solver->clone_pos);
+	array_destroy(solver->clone_required);
+	free(solver->table);
+	solver->table = NULL;
+	solver->table_sz = 0;
+}
+
+/* False if a limit cut the search short.  Nodes stay in solver.nodes
+ * until the next solve. */
+b32 solve(struct solver *solver, const struct map *map,
+          const struct solve_limits *limits, struct solve_stats *stats)
+{
+	struct level *level = &solver->level;
+	const u32 max_steps = min(limits->max_steps, 255);
+	u32 stop_steps = max_steps;
+
+	array_clear(solver->nodes);
+	array_clear(solver->keys);
+	if (solver->table)
+		memset(solver->table, 0, solver->table_sz * sizeof(u32));
+
+	level_init(level, solver->players, map);
+	memcpy(solver->actors, level->actors, sizeof(solver->actors));
+	array_clear(solver->clone_pos);
+	array_clear(solver->clone_required);
+	for (u32 i = 0; i < level->num_clones; ++i) {
+		array_append(solver->clone_pos, level->clone_pos[i]);
+		array_append(solver->clone_required, level->clone_required[i]);
+	}
+
+	stats->num_actors = level->num_actors;
+	stats->num_clones = level->num_clones;
+	stats->num_solutions = 0;
+	stats->min_solution_steps = UINT_MAX;
+	stats->num_shortest = 0;
+	stats->branching = 0;
+	stats->aborted = false;
+
+	{
+		b32 found;
+		const u32 root = solve__intern(solver, solve__encode(solver), &found);
+		solver->nodes[root].parent = UINT_MAX;
+		solver->nodes[root].action = ACTION_COUNT;
+		solver->nodes[root].paths = 1;
+	}
+
+	for (u32 n = 0; n < array_sz(solver->nodes) && !stats->aborted; ++n) {
+		const struct solve_node node = solver->nodes[n];
+
+		if (node.solved)
+			continue;
+		if (node.steps >= stop_steps)
+			break;
+
+		for (u32 action = 0, decoded = false; action < ACTION_COUNT; ++action) {
+			b32 possible = true, found;
+			u32 idx;
+
+			if (!action_is_solo(action) || action == ACTION_UNDO || action == ACTION_REDO)
+				continue;
+
+			if (!decoded)
+				solve__decode(solver, &node);
+			decoded = true;
+			for (u32 i = 0; i < level->num_actors; ++i)
+				if (!actor_can_act(&level->actors[i], level, action))
+					possible = false;
+			if (!possible)
+				continue;
+
+			decoded = false;
+			solve__apply(level, action);
+			idx = solve__intern(solver, solve__encode(solver), &found);
+			if (found) {
+				struct solve_node *other = &solver->nodes[idx];
+				if (other->steps == node.steps + 1)
+					other->paths = node.paths > SOLVE__PATHS_MAX - other->paths
+					             ? SOLVE__PATHS_MAX : other->paths + node.paths;
+				continue;
+			}
+
+			solver->nodes[idx].parent = n;
+			solver->nodes[idx].action = action;
+			solver->nodes[idx].steps = node.steps + 1;
+			solver->nodes[idx].paths = node.paths;
+			if (level_complete(level)) {
+				solver->nodes[idx].solved = true;
+				++stats->num_solutions;
+				if (stats->min_solution_steps == UINT_MAX) {
+					stats->min_solution_steps = node.steps + 1;
+					if (stats->min_solution_steps < limits->min_steps)
+						stats->aborted = true;
+					else if (limits->first_solution)
+						stop_steps = node.steps + 1;
+				}
+			}
+
+			if (array_sz(solver->nodes) >= limits->max_states)
+				stats->aborted = true;
+			if (stats->aborted)
+				break;
+		}
+	}
+
+	array_foreach(solver->nodes, struct solve_node, node)
+		if (node->solved && node->steps == stats->min_solution_steps)
+			stats->num_shortest = node->paths > SOLVE__PATHS_MAX - stats->num_shortest
+			                    ? SOLVE__PATHS_MAX : stats->num_shortest + node->paths;
+
+	stats->num_states = array_sz(solver->nodes);
+	/* b with b^steps positions, as if every move opened b new ones */
+	if (stats->min_solution_steps != UINT_MAX && stats->min_solution_steps > 0)
+		stats->branching = powf((r32)stats->num_states, 1.f / stats->min_solution_steps);
+
+	for (u32 i = 0; i < PLAYER_CNT_MAX; ++i)
+		player_destroy(&solver->players[i]);
+	level_destroy(level);
+	return !stats->aborted;
+}
+
+/* The moves from the start to a node, returning how many there are */
+u32 solver_path(const struct solver *solver, u32 node, enum action path[], u32 n)
+{
+	const u32 steps = solver->nodes[node].steps;
+	assert(steps <= n);
+	for (u32 i = steps; i > 0; --i) {
+		path[i-1] = solver->nodes[node].action;
+		node = solver->nodes[node].parent;
+	}
+	return steps;
+}
@@ -0,0 +1,5 @@
+void solver_init(struct solver *solver);
+void solver_destroy(struct solver *solver);
+b32  solve(struct solver *solver, const struct map *map,
+           const struct solve_limits *limits, struct solve_stats *stats);
+u32  solver_path(const struct solver *solver, u32 node, enum action path[], u32 n);
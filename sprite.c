@@ -0,0 +1,212 @@
+#include "config.h"
+#include "violet/all.h"
+#include "action.h"
+#include "types.h"
+#include "render_types.h"
+#include "disk.h"
+#include "sprite.h"
+
+/*
+ * All figure sprites are decoded at startup and packed into one image.
+ * Images are packed left to right in rows as tall as the tallest image in
+ * them.  Only the flush touches the gui or GL.
+ *
+ * The gui can only draw whole images, so each sprite & tint drawn gets a
+ * texture of its own, cut from the atlas and uploaded once, the first
+ * time it is flushed.  After that a batch is one gui_img_ex() per figure,
+ * queued back to back, with nothing rebuilt or uploaded per frame.
+ *
+ * Each image can also get a grayscale copy in the atlas, which is tinted
+ * when first drawn so that recoloured figures cost no extra image files.
+ */
+
+/* Luminance, stretched so the brightest pixel in the image is white */
+static
+void sprite__grayscale(u8 *dst, const u8 *src, s32 npixels)
+{
+	u32 max_l = 1;
+	for (s32 i = 0; i < npixels; ++i) {
+		const u32 l = (src[i*4] * 77 + src[i*4+1] * 150 + src[i*4+2] * 29) >> 8;
+		if (src[i*4+3])
+			max_l = max(max_l, l);
+		dst[i*4] = l;
+	}
+	for (s32 i = 0; i < npixels; ++i) {
+		const u8 l = min(dst[i*4] * 255 / max_l, 255);
+		dst[i*4+0] = l;
+		dst[i*4+1] = l;
+		dst[i*4+2] = l;
+		dst[i*4+3] = src[i*4+3];
+	}
+}
+
+static
+void sprite__blit(u8 *atlas_pixels, s32 atlas_w, const struct sprite *sprite,
+                  const u8 *pixels)
+{
+	for (s32 y = 0; y < sprite->dim.y; ++y)
+		memcpy(&atlas_pixels[((sprite->pos.y + y) * atlas_w + sprite->pos.x) * 4],
+		       &pixels[y * sprite->dim.x * 4], sprite->dim.x * 4);
+}
+
+b32 sprite_image_load(struct sprite_image *image, const char *fname)
+{
+	int w, h, comp;
+
+	/* the archive holds images already decoded */
+	image->pixels = archive_find_image(fname, &image->dim);
+	image->archived = image->pixels != NULL;
+	if (image->archived)
+		return true;
+
+	image->pixels = stbi_load(fname, &w, &h, &comp, 4);
+	if (!image->pixels) {
+		log_error("failed to load sprite %s", fname);
+		image->dim = g_v2i_zero;
+		return false;
+	}
+	image->dim = (v2i){ .x = w, .y = h };
+	return true;
+}
+
+void sprite_image_destroy(struct sprite_image *image)
+{
+	if (image->pixels && !image->archived)
+		stbi_image_free((void*)image->pixels);
+	image->pixels = NULL;
+}
+
+/* sprites_gray may be NULL if no tintable copies are needed */
+b32 sprite_atlas_init(struct sprite_atlas *atlas, const struct sprite_image images[],
+                      u32 n, struct sprite sprites[], struct sprite sprites_gray[])
+{
+	u8 *atlas_pixels = NULL, *gray = NULL;
+	const u32 copies = sprites_gray ? 2 : 1;
+	s32 atlas_w = 0, atlas_h = 0, max_w = 0, max_sz = 0, cols;
+	v2i cursor = g_v2i_zero;
+	s32 row_h = 0;
+	u32 i;
+
+	for (i = 0; i < n; ++i) {
+		if (!images[i].pixels)
+			return false;
+		sprites[i].dim = images[i].dim;
+		if (sprites_gray)
+			sprites_gray[i].dim = sprites[i].dim;
+		max_w = max(max_w, images[i].dim.x);
+		max_sz = max(max_sz, images[i].dim.x * images[i].dim.y);
+	}
+
+	cols = 1;
+	while ((u32)(cols * cols) < n * copies)
+		++cols;
+	atlas_w = cols * max_w;
+
+	for (i = 0; i < n * copies; ++i) {
+		struct sprite *sprite = i < n ? &sprites[i] : &sprites_gray[i - n];
+		if (cursor.x + sprite->dim.x > atlas_w) {
+			cursor.x = 0;
+			cursor.y += row_h;
+			row_h = 0;
+		}
+		sprite->pos = cursor;
+		cursor.x += sprite->dim.x;
+		row_h = max(row_h, sprite->dim.y);
+	}
+	atlas_h = cursor.y + row_h;
+
+	atlas_pixels = calloc(atlas_w * atlas_h, 4);
+	if (sprites_gray)
+		gray = malloc(max_sz * 4);
+	for (i = 0; i < n; ++i) {
+		sprite__blit(atlas_pixels, atlas_w, &sprites[i], images[i].pixels);
+		if (sprites_gray) {
+			sprite__grayscale(gray, images[i].pixels, sprites[i].dim.x * sprites[i].dim.y);
+			sprite__blit(atlas_pixels, atlas_w, &sprites_gray[i], gray);
+		}
+	}
+	atlas->pixels = atlas_pixels;
+	atlas->dim = (v2i){ .x = atlas_w, .y = atlas_h };
+	atlas->textures = array_create();
+
+	free(gray);
+	return true;
+}
+
+void sprite_atlas_destroy(struct sprite_atlas *atlas)
+{
+	if (!atlas->pixels)
+		return; /* never built */
+	array_foreach(atlas->textures, struct sprite_texture, texture)
+		img_destroy(&texture->img);
+	array_destroy(atlas->textures);
+	free(atlas->pixels);
+	atlas->pixels = NULL;
+}
+
+void sprite_batch_init(struct sprite_batch *batch)
+{
+	batch->draws = array_create();
+}
+
+void sprite_batch_destroy(struct sprite_batch *batch)
+{
+	array_destroy(batch->draws);
+}
+
+void sprite_batch_add(struct sprite_batch *batch, v2i pos, const struct sprite *sprite,
+                      r32 scale, color_t tint)
+{
+	const struct sprite_draw draw = {
+		.pos = pos,
+		.sprite = sprite,
+		.scale = scale,
+		.tint = tint,
+	};
+	array_append(batch->draws, draw);
+}
+
+/* Only a few dozen sprite & tint pairs are ever drawn, so a scan will do */
+static
+u32 sprite__texture(struct sprite_atlas *atlas, const struct sprite *sprite, color_t tint)
+{
+	struct sprite_texture texture = { .sprite = sprite, .tint = tint };
+	u8 *pixels;
+
+	for (u32 i = 0; i < array_sz(atlas->textures); ++i) {
+		const struct sprite_texture *existing = &atlas->textures[i];
+		if (   existing->sprite == sprite
+		    && existing->tint.r == tint.r && existing->tint.g == tint.g
+		    && existing->tint.b == tint.b && existing->tint.a == tint.a)
+			return i;
+	}
+
+	pixels = malloc(sprite->dim.x * sprite->dim.y * 4);
+	for (s32 y = 0; y < sprite->dim.y; ++y) {
+		const u8 *src = &atlas->pixels[((sprite->pos.y + y) * atlas->dim.x + sprite->pos.x) * 4];
+		u8 *dst = &pixels[y * sprite->dim.x * 4];
+		for (s32 x = 0; x < sprite->dim.x; ++x) {
+			dst[x*4+0] = src[x*4+0] * tint.r / 255;
+			dst[x*4+1] = src[x*4+1] * tint.g / 255;
+			dst[x*4+2] = src[x*4+2] * tint.b / 255;
+			dst[x*4+3] = src[x*4+3] * tint.a / 255;
+		}
+	}
+	texture_init(&texture.img.texture, sprite->dim.x, sprite->dim.y, GL_RGBA, pixels);
+	free(pixels);
+	array_append(atlas->textures, texture);
+	return array_sz(atlas->textures) - 1;
+}
+
+void sprite_batch_flush(struct sprite_batch *batch, gui_t *gui,
+                        struct sprite_atlas *atlas)
+{
+	/* adding a texture may move the others, so none is handed out until
+	 * all exist */
+	array_foreach(batch->draws, struct sprite_draw, draw)
+		draw->texture = sprite__texture(atlas, draw->sprite, draw->tint);
+	array_foreach(batch->draws, const struct sprite_draw, draw)
+		gui_img_ex(gui, draw->pos.x, draw->pos.y, &atlas->textures[draw->texture].img,
+		           draw->scale, draw->scale, 1.f);
+	array_clear(batch->draws);
+}
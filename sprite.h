@@ -0,0 +1,13 @@
+b32  sprite_image_load(struct sprite_image *image, const char *fname);
+void sprite_image_destroy(struct sprite_image *image);
+
+b32  sprite_atlas_init(struct sprite_atlas *atlas, const struct sprite_image images[],
+                       u32 n, struct sprite sprites[], struct sprite sprites_gray[]);
+void sprite_atlas_destroy(struct sprite_atlas *atlas);
+
+void sprite_batch_init(struct sprite_batch *batch);
+void sprite_batch_destroy(struct sprite_batch *batch);
+void sprite_batch_add(struct sprite_batch *batch, v2i pos, const struct sprite *sprite,
+                      r32 scale, color_t tint);
+void sprite_batch_flush(struct sprite_batch *batch, gui_t *gui,
+                        struct sprite_atlas *atlas);
@@ -0,0 +1,165 @@
+#include <SDL.h>
+#include "config.h"
+#include "violet/all.h"
+#include "task.h"
+
+/*
+ * Jobs wait in a fixed ring guarded by one mutex; workers sleep on a
+ * condition variable until one arrives.  A job must not touch the gui or
+ * GL, so its results are picked up on the main thread once
+ * tasks_pending() reaches 0.  Without threads (emscripten), or with the
+ * ring full, task_run() simply runs the job itself.
+ */
+
+struct task__job
+{
+	void (*fn)(void *udata);
+	void *udata;
+};
+
+#ifndef __EMSCRIPTEN__
+static SDL_Thread *g_workers[TASK_WORKER_CNT_MAX];
+static u32 g_num_workers = 0;
+static SDL_mutex *g_mutex = NULL;
+static SDL_cond *g_job_added = NULL;
+static SDL_cond *g_job_done = NULL;
+static struct task__job g_jobs[TASK_QUEUE_MAX];
+static u32 g_job_head = 0, g_num_jobs = 0;
+static u32 g_num_running = 0;
+static b32 g_quit = false;
+
+
+static
+int task__worker(void *udata)
+{
+	SDL_LockMutex(g_mutex);
+	for (;;) {
+		struct task__job job;
+
+		while (g_num_jobs == 0 && !g_quit)
+			SDL_CondWait(g_job_added, g_mutex);
+		if (g_num_jobs == 0)
+			break;
+
+		job = g_jobs[g_job_head];
+		g_job_head = (g_job_head + 1) % TASK_QUEUE_MAX;
+		--g_num_jobs;
+		++g_num_running;
+		SDL_UnlockMutex(g_mutex);
+
+		job.fn(job.udata);
+
+		SDL_LockMutex(g_mutex);
+		--g_num_running;
+		if (g_num_jobs == 0 && g_num_running == 0)
+			SDL_CondBroadcast(g_job_done);
+	}
+	SDL_UnlockMutex(g_mutex);
+	return 0;
+}
+#endif
+
+/* One worker per core beyond the main thread, at least one */
+b32 tasks_init(void)
+{
+#ifndef __EMSCRIPTEN__
+	const u32 num_workers = (u32)clamp(1, SDL_GetCPUCount() - 1, TASK_WORKER_CNT_MAX);
+
+	g_mutex = SDL_CreateMutex();
+	g_job_added = SDL_CreateCond();
+	g_job_done = SDL_CreateCond();
+	if (!g_mutex || !g_job_added || !g_job_done) {
+		log_error("Unable to create task sync: %s", SDL_GetError());
+		tasks_destroy();
+		return false;
+	}
+
+	g_quit = false;
+	for (u32 i = 0; i < num_workers; ++i) {
+		g_workers[g_num_workers] = SDL_CreateThread(task__worker, "task", NULL);
+		if (!g_workers[g_num_workers]) {
+			log_warn("Unable to start task worker: %s", SDL_GetError());
+			break;
+		}
+		++g_num_workers;
+	}
+#endif
+	return true;
+}
+
+/* Finishes the queued jobs first */
+void tasks_destroy(void)
+{
+#ifndef __EMSCRIPTEN__
+	if (g_mutex) {
+		SDL_LockMutex(g_mutex);
+		g_quit = true;
+		SDL_CondBroadcast(g_job_added);
+		SDL_UnlockMutex(g_mutex);
+	}
+	for (u32 i = 0; i < g_num_workers; ++i)
+		SDL_WaitThread(g_workers[i], NULL);
+	g_num_workers = 0;
+
+	if (g_job_done)
+		SDL_DestroyCond(g_job_done);
+	if (g_job_added)
+		SDL_DestroyCond(g_job_added);
+	if (g_mutex)
+		SDL_DestroyMutex(g_mutex);
+	g_job_done = NULL;
+	g_job_added = NULL;
+	g_mutex = NULL;
+#endif
+}
+
+void task_run(void (*fn)(void *udata), void *udata)
+{
+#ifndef __EMSCRIPTEN__
+	if (g_num_workers > 0) {
+		SDL_LockMutex(g_mutex);
+		if (g_num_jobs < TASK_QUEUE_MAX) {
+			struct task__job *job = &g_jobs[(g_job_head + g_num_jobs) % TASK_QUEUE_MAX];
+			job->fn = fn;
+			job->udata = udata;
+			++g_num_jobs;
+			SDL_CondSignal(g_job_added);
+			SDL_UnlockMutex(g_mutex);
+			return;
+		}
+		SDL_UnlockMutex(g_mutex);
+	}
+#endif
+	fn(udata);
+}
+
+/* Jobs queued or still running */
+u32 tasks_pending(void)
+{
+#ifndef __EMSCRIPTEN__
+	u32 pending;
+
+	if (g_num_workers == 0)
+		return 0;
+
+	SDL_LockMutex(g_mutex);
+	pending = g_num_jobs + g_num_running;
+	SDL_UnlockMutex(g_mutex);
+	return pending;
+#else
+	return 0;
+#endif
+}
+
+void tasks_wait(void)
+{
+#ifndef __EMSCRIPTEN__
+	if (g_num_workers == 0)
+		return;
+
+	SDL_LockMutex(g_mutex);
+	while (g_num_jobs > 0 || g_num_running > 0)
+		SDL_CondWait(g_job_done, g_mutex);
+	SDL_UnlockMutex(g_mutex);
+#endif
+}
@@ -0,0 +1,9 @@
+/*
+ * Pool of worker threads for slow, self-contained jobs like decoding assets
+ */
+
+b32  tasks_init(void);
+void tasks_destroy(void);
+void task_run(void (*fn)(void *udata), void *udata);
+u32  tasks_pending(void);
+void tasks_wait(void);
@@ -11,24 +11,49 @@ enum tile_type {
 
 struct tile {
 	enum tile_type type;
-	color_t active_color;
-	r32 t;
 #ifdef SHOW_TRAVELLED
 	b32 travelled;
 #endif
 };
 
+struct tile_chunk {
+	u32 refs; /* maps sharing the chunk, see map.c */
+	struct tile tiles[MAP_CHUNK_DIM][MAP_CHUNK_DIM];
+};
+
+/* Row-major grid of chunks, NULL where every tile is blank */
 struct map {
 	char tip[MAP_TIP_MAX];
 	char desc[MAP_TIP_MAX];
 	v2i dim;
-	struct tile tiles[MAP_DIM_MAX][MAP_DIM_MAX];
+	struct tile_chunk **chunks;
 	u32 actor_controlled_by_player[ACTOR_CNT_MAX];
 };
 
-struct clone {
-	v2i pos;
-	b32 required;
+struct map_cache_entry {
+	u32 idx;
+	u32 last_used;
+	struct map map;
+};
+
+/* A map file indexed on open, decoding levels on demand */
+struct map_pack {
+	array(struct map) *maps;
+	FILE *fp;
+	const u8 *data;
+	size_t size;
+	b32 data_owned; /* false when data lives in the asset archive */
+	array(u32) offsets;
+	struct map_cache_entry cache[MAP_CACHE_CNT];
+	u32 clock;
+};
+
+/* One file for save_archive; dim is non-zero for decoded RGBA images */
+struct archive_file {
+	const char *name;
+	const void *data;
+	u32 size;
+	v2i dim;
 };
 
 enum dir {
@@ -42,38 +67,89 @@ enum dir {
 struct actor {
 	u32 player;
 	v2i tile;
-	v2f pos;
+	v2i pos, prev_pos; /* SUBTILE_DIM units per tile, prev_pos as of the last tick */
 	enum dir dir;
 	enum dir facing;
 	u32 anim_milli;
-	struct clone clones[CLONE_CNT_MAX];
-	u32 num_clones;
+	u32 num_clones; /* attached, see level.clone_owner */
+};
+
+#define ACTOR_NONE (~0u)
+#define CLONE_NONE (~0u)
+
+/* Valid only while stamp matches the level's occupancy_stamp */
+struct occupant {
+	u32 stamp;
+	u32 player; /* PLAYER_CNT_MAX for a free clone */
+	u32 clone;  /* or CLONE_NONE for an actor */
 };
 
+/* The clones are one pool, a field per array, see level.c */
 struct level {
 	struct map map;
+	struct occupant *occupancy;
+	u32 occupancy_stamp;
 	struct actor actors[ACTOR_CNT_MAX];
 	u32 num_actors;
-	struct clone clones[CLONE_CNT_MAX];
-	u32 num_clones;
+	v2i *clone_pos;     /* relative to the owner's tile once attached */
+	u32 *clone_owner;   /* actor index, or ACTOR_NONE while free */
+	u32 *clone_order;   /* how many the owner had attached before it */
+	u8 *clone_required;
+	u32 *clone_stack;   /* scratch for actor_entered_tile */
+	u32 num_clones, clones_cap;
+	u32 num_free_clones; /* lets pick-ups stop once there are none */
 	b32 complete;
 };
 
-struct history_event
+struct history_snapshot
 {
-	enum action action;
-	u32 num_clones;
+	u32 num_events;
+	u32 pos;   /* byte offset into history.events */
+	u32 state; /* byte offset into history.states */
 };
 
+#define HISTORY_BRANCH_LINE (~0u)
+
+/* A redo tail set aside when a different move was made at its fork */
+struct history_branch
+{
+	u32 parent;     /* a branch index, or HISTORY_BRANCH_LINE */
+	u32 num_events; /* before the fork */
+	u32 pos;        /* byte offset of the fork */
+	u8 *events;
+	u32 len, num_events_len;
+	struct history_snapshot *snapshots; /* offsets relative to the fork */
+	u32 num_snapshots;
+	u8 *states;
+	u32 states_sz;
+};
+
+/* Zero-initialized is empty; see history.c for the packing */
 struct history
 {
-	struct history_event events[HISTORY_EVENT_MAX];
-	u32 begin;
-	u32 end;
+	u8 *events;
+	u32 sz;  /* bytes up to the present */
+	u32 len; /* bytes including the redo tail */
+	u32 cap;
+	u32 num_events;     /* up to the present */
+	u32 num_events_len; /* including the redo tail */
+	struct history_snapshot *snapshots;
+	u32 num_snapshots, snapshots_cap;
+	u8 *states;
+	u32 states_sz, states_cap;
+	struct history_branch *branches;
+	u32 num_branches, branches_cap;
+};
+
+struct input {
+	enum action action;
+	u32 time; /* SDL_GetTicks() of the key press */
 };
 
 struct player {
-	const gui_key_t *key_bindings;
+	struct input inputs[INPUT_QUEUE_MAX]; /* ring buffer, oldest first */
+	u32 input_head, num_inputs;
+	u32 actions_held; /* bit per action */
 	struct actor *actors[ACTOR_CNT_MAX];
 	u32 num_actors;
 	enum action last_action;
@@ -82,17 +158,91 @@ struct player {
 	struct history history;
 };
 
-struct effect {
-	v2i pos;
-	color_t color;
-	r32 t;
-	u32 duration;
+enum sim_event {
+	SIM_EVENT_SLIDE   = 1 << 0,
+	SIM_EVENT_SWIPE   = 1 << 1,
+	SIM_EVENT_UNDO    = 1 << 2,
+	SIM_EVENT_RESET   = 1 << 3, /* the caller restarts the level */
+	SIM_EVENT_BLOCKED = 1 << 4,
+};
+
+/* The level as of a history snapshot, for single-player jumps.  The
+ * clones' positions, owners & orders follow, num_clones of each. */
+struct sim_snapshot {
+	struct actor actors[ACTOR_CNT_MAX];
+	u32 num_actors;
+	u32 num_clones;
+};
+
+/* Recorded in sim_input.action alongside the player actions */
+enum sim_command {
+	SIM_COMMAND_SEEK = ACTION_COUNT, /* to sim_input.arg moves */
+	SIM_COMMAND_BRANCH,
+	SIM_COMMAND_COUNT,
+};
+
+struct sim_input {
+	u32 tick;
+	u16 player;
+	u16 action;
+	u32 arg;
+};
+
+struct sim {
+	struct level *level;
+	struct player *players;
+	u32 num_players;
+	u32 tick;
+	array(struct sim_input) *log; /* every action & command is appended when set */
+};
+
+/* One level played from its start, as recorded for replay */
+struct replay_run {
+	char maps_file_name[128];
+	u32 level_idx;
+	u32 num_players;
+	array(struct sim_input) inputs;
+};
+
+/* When solve() gives up early, see solve.c */
+struct solve_limits {
+	u32 max_states;      /* positions known */
+	u32 min_steps;       /* any shorter solution */
+	u32 max_steps;       /* depth searched */
+	b32 first_solution;  /* stop once the shortest solutions are counted */
+};
+
+struct solve_stats {
+	u32 num_actors;
+	u32 num_clones;
+	u32 num_states;
+	u32 num_solutions;      /* solved positions found */
+	u32 min_solution_steps; /* UINT_MAX when unsolved */
+	u32 num_shortest;       /* distinct shortest solutions, saturating */
+	r32 branching;          /* effective branching factor */
+	b32 aborted;
+};
+
+/* A position reached by the solver, and the move that first reached it */
+struct solve_node {
+	u32 parent;
+	u32 key;   /* offset into solver.keys */
+	u32 paths; /* shortest paths here, saturating */
+	u16 key_len;
+	u8 steps;
+	u8 action;
+	u8 solved;
 };
 
-struct effect2 {
-	v2f pos;
-	color_t color;
-	r32 t;
-	u32 duration;
-	r32 rotation_start, rotation_rate;
+/* Reusable between solves, so repeated solving allocates nothing */
+struct solver {
+	array(struct solve_node) nodes;
+	array(u32) keys;
+	u32 *table; /* node index + 1, open addressing */
+	u32 table_sz;
+	struct level level;
+	struct player players[PLAYER_CNT_MAX];
+	struct actor actors[ACTOR_CNT_MAX]; /* as the level starts */
+	array(v2i) clone_pos;
+	array(u8) clone_required;
 };